@@ -0,0 +1,46 @@
+// Counts every heap allocation of the program: replaces the global operator new / delete with
+// malloc / free plus an atomic counter, so a test or benchmark can check how many allocations a stretch
+// of code made (allocationCount() before and after).
+// Replacement allocation functions can't be inline, so include this from exactly one .cpp of a
+// program. The tests and bench_runner use it; the app and the analyzer itself never do.
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Atomic because the threaded ingest modes allocate on their worker threads too.
+inline std::atomic<size_t> &allocationCounter()
+{
+    static std::atomic<size_t> count{0};
+    return count;
+}
+
+inline size_t allocationCount()
+{
+    return allocationCounter().load(std::memory_order_relaxed);
+}
+
+// GCC can't tell that the malloc below pairs with the free in operator delete.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(size_t n)
+{
+    allocationCounter().fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
@@ -1,228 +1,1610 @@
 // This is our main place, like theengine room, here we take data from CSV and rank it.
 
 #include "analyzer.h"
+#include "row_parse.h"
+#include "spsc_ring.h"
 #include <fstream>
 #include <algorithm>
 #include <cctype>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TRIP_HAVE_MMAP 1
+#endif
+
+// Smallest byte range worth handing to its own thread in IngestMode::Parallel.
+#ifndef TRIP_PARALLEL_MIN_CHUNK
+#define TRIP_PARALLEL_MIN_CHUNK (1 << 20)
+#endif
+
+// Bytes the reader stage of IngestMode::Pipelined asks for per read.
+#ifndef TRIP_PIPELINE_BLOCK
+#define TRIP_PIPELINE_BLOCK (1 << 20)
+#endif
+
 using namespace std;
 
-// HELPERS AND PARSING FUNCTIONS
+// ZONE DICTIONARY PART
 
-// Clean up r
-static inline void stripTrailingCR(string &s)
+uint64_t ZoneDict::hash(std::string_view zone)
 {
-    if (!s.empty() && s.back() == '\r')
-        s.pop_back();
+    // Seeded per process (seeded_hash.h), so a feed can't be built to make every zone collide.
+    return seededHash(zone, hashSeed());
 }
 
-// A little check of a the data row, we shouldn't waste time attempting to parse it if there aren't at least five commas because there are missing columns.
-static inline int countCommas(const char *s)
+inline bool ZoneDict::matches(const Slot &slot, uint32_t h, string_view zone) const
 {
-    int commas = 0;
-    for (const char *p = s; *p; ++p)
-        if (*p == ',')
-            ++commas;
-    return commas;
+    if (slot.hash != h || slot.len != zone.size())
+        return false;
+    // Short keys live entirely in the slot; long ones keep their first bytes there and the rest in names.
+    size_t head = min<size_t>(zone.size(), inlineKeyBytes);
+    if (memcmp(slot.key, zone.data(), head) != 0)
+        return false;
+    return zone.size() <= inlineKeyBytes ||
+           memcmp(names[slot.id].data() + head, zone.data() + head, zone.size() - head) == 0;
 }
 
-// Digs into the "YYYY-MM-DD HH:MM" string to find JUST the hour.
-static inline int parseHourFromDatetime(const char *p)
+uint32_t ZoneDict::find(string_view zone) const
 {
-    // move to the space between date and time
-    while (*p && *p != ' ' && *p != ',')
-        ++p;
+    return find(zone, hash(zone));
+}
 
-    // If we hit a comma here or the end of the line before finding a space, the format is wrong.
-    if (!*p || *p == ',')
-        return -1;
+uint32_t ZoneDict::find(string_view zone, uint64_t zoneHash) const
+{
+    if (slots.empty())
+        return npos;
 
-    // skip space to get HH part.
-    while (*p == ' ')
-        ++p;
+    uint32_t h = static_cast<uint32_t>(zoneHash);
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask)
+    {
+        const Slot &slot = slots[i];
+        if (slot.id == npos)
+            return npos;
+        if (matches(slot, h, zone))
+            return slot.id;
+    }
+}
 
-    // now at HH:MM
-    if (!isdigit(static_cast<unsigned char>(*p)))
-        return -1;
+void ZoneDict::prefetch(uint64_t zoneHash) const
+{
+    if (!slots.empty())
+        __builtin_prefetch(&slots[static_cast<uint32_t>(zoneHash) & (slots.size() - 1)]);
+}
+
+uint32_t ZoneDict::intern(string_view zone)
+{
+    // Keep the load at most 1/2 so a miss ends after a couple of probes.
+    if (internGrows())
+        grow(max<size_t>(16, slots.size() * 2));
 
-    int hour = 0;
-    while (isdigit(static_cast<unsigned char>(*p)))
+    uint32_t h = static_cast<uint32_t>(hash(zone));
+    size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    for (;; i = (i + 1) & mask)
     {
-        hour = hour * 10 + (*p - '0');
-        ++p;
+        const Slot &slot = slots[i];
+        if (slot.id == npos)
+            break;
+        if (matches(slot, h, zone))
+            return slot.id;
     }
-    // check hour range
-    if (hour < 0 || hour > 23)
-        return -1;
-    return hour;
+
+    // First time we see this zone: one owned copy in names, its hash and prefix in the slot.
+    uint32_t id = static_cast<uint32_t>(names.size());
+    names.emplace_back(arena.store(zone), zone.size());
+    Slot &slot = slots[i];
+    slot.hash = h;
+    slot.id = id;
+    slot.len = static_cast<uint32_t>(zone.size());
+    memcpy(slot.key, zone.data(), min<size_t>(zone.size(), inlineKeyBytes));
+    return id;
 }
 
-// Extract PickupZoneID (column 1) and hour(from column 3) from a 6-column data row.
-// Returns true if the row is usable, false if it should be skipped with the main Slicer Grgabs the zone ID and the hour from a single line of the data.
-static bool parseRow6(const string &line, string &zoneOut, int &hourOut)
+ZoneDict::ZoneDict(const ZoneDict &other) : slots(other.slots)
 {
-    const char *buf = line.c_str();
-    const char *p = buf;
+    names.reserve(other.names.size());
+    for (string_view name : other.names)
+        names.emplace_back(arena.store(name), name.size());
+}
 
-    // Quick check for malformed rows.
-    // Validation space
-    if (countCommas(buf) < 5)
-        return false;
+ZoneDict &ZoneDict::operator=(const ZoneDict &other)
+{
+    if (this != &other)
+        *this = ZoneDict(other);
+    return *this;
+}
+
+const char *ZoneDict::Arena::store(string_view bytes)
+{
+    if (bytes.size() > left)
+    {
+        // A name bigger than a quarter block gets a block of its own, so the rest of the
+        // current block isn't thrown away for it.
+        if (bytes.size() > blockBytes / 4)
+        {
+            blocks.emplace_back(new char[bytes.size()]);
+            memcpy(blocks.back().get(), bytes.data(), bytes.size());
+            return blocks.back().get();
+        }
+        blocks.emplace_back(new char[blockBytes]);
+        next = blocks.back().get();
+        left = blockBytes;
+    }
+    char *out = next;
+    // An empty name (a snapshot can hold one) stored before the first block gets nullptr back, which is
+    // fine for a zero-length string_view; memcpy is skipped since it must not see a null pointer.
+    if (!bytes.empty())
+        memcpy(out, bytes.data(), bytes.size());
+    next += bytes.size();
+    left -= bytes.size();
+    return out;
+}
+
+void ZoneDict::grow(size_t capacity)
+{
+    // Every slot remembers its hash, so re-placing keys never touches the strings.
+    vector<Slot> old(capacity);
+    old.swap(slots);
+    size_t mask = capacity - 1;
+    for (const Slot &slot : old)
+    {
+        if (slot.id == npos)
+            continue;
+        size_t i = slot.hash & mask;
+        while (slots[i].id != npos)
+            i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+}
+
+void ZoneDict::reserve(size_t n)
+{
+    size_t capacity = 16;
+    while (capacity < n * 2)
+        capacity *= 2;
+    if (capacity > slots.size())
+        grow(capacity);
+    names.reserve(n);
+}
+
+// TRIP ANALYZER PART
 
-    // 1Skip Column 0 the (TripID) by running until we hit the first other comma.
-    while (*p && *p != ',')
-        ++p;
-    if (!*p)
+// Strips the '\r' and tells whether the line is a row to parse: not empty, and not the header
+// (only the very first non-empty line of a file can be the header).
+static inline bool isDataLine(const char *s, const char *&e, bool &headerHandled)
+{
+    stripTrailingCR(s, e);
+    if (s == e)
         return false;
-    ++p; // skip comma
-
-    // 2Extract column 1 PickupZoneID
-    while (*p == ' ' || *p == '\t')
-        ++p;
-    const char *zoneStart = p;
-    while (*p && *p != ',')
-        ++p;
-    if (!*p)
+
+    // Skip the very first line if it contains TripID (the headers of it).
+    if (!headerHandled)
+    {
+        headerHandled = true;
+        if (looksLikeHeader(s, e))
+            return false;
+        // else: treat first line as data (fall through to parse)
+    }
+    return true;
+}
+
+// Counts a data line in stats, accepted or under the reason it was rejected, and passes accepted on.
+static inline bool tallyRow(IngestStats &stats, bool accepted, const char *s, const char *e)
+{
+    statAdd(stats.rowsSeen, 1);
+#if TRIP_STATS
+    if (accepted)
+    {
+        ++stats.rowsAccepted;
+        return true;
+    }
+    switch (classifyRejectedRow(s, e))
+    {
+    case RowReject::FewCommas: ++stats.rejectedFewCommas; break;
+    case RowReject::EmptyZone: ++stats.rejectedEmptyZone; break;
+    case RowReject::BadDatetime: ++stats.rejectedBadDatetime; break;
+    case RowReject::HourRange: ++stats.rejectedHourRange; break;
+    }
+#else
+    (void)s;
+    (void)e;
+#endif
+    return accepted;
+}
+
+// Runs step; if it is going to move entries that are already stored (moves), its time goes to
+// stats as one rehash. Without TRIP_STATS this is just step().
+template <class Step>
+static inline void timedRehash(IngestStats &stats, bool moves, Step &&step)
+{
+#if TRIP_STATS
+    if (moves)
+    {
+        uint64_t start = statClock();
+        step();
+        stats.rehashNs += statClock() - start;
+        ++stats.rehashes;
+        return;
+    }
+#else
+    (void)stats;
+    (void)moves;
+#endif
+    step();
+}
+
+void TripAnalyzer::setIngestMode(IngestMode mode)
+{
+    ingestMode = mode;
+}
+
+void TripAnalyzer::setRowScanner(RowScanner scanner)
+{
+    rowScanner = scanner;
+}
+
+void TripAnalyzer::setThreadCount(unsigned threads)
+{
+    threadCount = threads;
+}
+
+void TripAnalyzer::setIncrementalTopK(size_t capacity)
+{
+    boardCapacity = capacity;
+    rebuildBoards();
+}
+
+bool TripAnalyzer::setSketch(size_t width, size_t depth, bool keepExact)
+{
+    // Sketch-only with data: the exact tables are gone, so a new sketch would have nothing to start from.
+    if (!exactCounts && zoneSketch.total() > 0)
+        return !keepExact && width == zoneSketch.width() && depth == zoneSketch.depth();
+
+    ++generation;
+    zoneSketch = CountMinSketch(width, depth);
+    slotSketch = CountMinSketch(width, depth);
+    sketchCounts(*this);
+
+    exactCounts = keepExact || !zoneSketch.enabled();
+    if (!exactCounts)
+        freeExactTables();
+    return true;
+}
+
+void TripAnalyzer::freeExactTables()
+{
+    exactCounts = false;
+    zones = ZoneDict();
+    zoneStats = vector<ZoneStats>();
+    rebuildBoards();
+}
+
+void TripAnalyzer::sketchCounts(const TripAnalyzer &from)
+{
+    if (!zoneSketch.enabled())
+        return;
+    for (uint32_t id = 0; id < from.zoneStats.size(); ++id)
+    {
+        const ZoneStats &st = from.zoneStats[id];
+        uint64_t h = ZoneDict::hash(from.zones.name(id));
+        zoneSketch.add(h, st.total);
+        for (int hour = 0; hour < hoursPerDay; ++hour)
+            slotSketch.add(CountMinSketch::combine(h, hour), st.hours[hour]);
+    }
+}
+
+long long TripAnalyzer::estimateZone(std::string_view zone) const
+{
+    if (zoneSketch.enabled())
+        return zoneSketch.estimate(ZoneDict::hash(zone));
+    if (approxCapacity)
+    {
+        const SpaceSaving::Entry *e = zoneSummary.find(zone);
+        return e ? e->count : zoneSummary.untrackedBound();
+    }
+    return countForZone(zone);
+}
+
+long long TripAnalyzer::estimateSlot(std::string_view zone, int hour) const
+{
+    if (hour < 0 || hour >= hoursPerDay)
+        return 0;
+    if (slotSketch.enabled())
+        return slotSketch.estimate(CountMinSketch::combine(ZoneDict::hash(zone), hour));
+    if (approxCapacity)
+    {
+        string key;
+        slotKey(key, zone, hour);
+        const SpaceSaving::Entry *e = slotSummary.find(key);
+        return e ? e->count : slotSummary.untrackedBound();
+    }
+    return countForSlot(zone, hour);
+}
+
+long long TripAnalyzer::sketchErrorBound() const
+{
+    return max(zoneSketch.errorBound(), slotSketch.errorBound());
+}
+
+long long TripAnalyzer::countForZone(std::string_view zone) const
+{
+    uint32_t id = zones.find(zone);
+    return id == ZoneDict::npos ? 0 : zoneStats[id].total;
+}
+
+long long TripAnalyzer::countForSlot(std::string_view zone, int hour) const
+{
+    if (hour < 0 || hour >= hoursPerDay)
+        return 0;
+    uint32_t id = zones.find(zone);
+    return id == ZoneDict::npos ? 0 : zoneStats[id].hours[hour];
+}
+
+std::vector<uint32_t> TripAnalyzer::findZones(const std::vector<std::string_view> &zoneList) const
+{
+    // Hash everything first, then probe with the slot of the key a few places ahead already on its
+    // way in, so a batch of cold lookups doesn't pay one full cache miss after the other.
+    const size_t ahead = 8;
+    vector<uint64_t> hashes(zoneList.size());
+    for (size_t i = 0; i < zoneList.size(); ++i)
+        hashes[i] = ZoneDict::hash(zoneList[i]);
+    for (size_t i = 0; i < min(ahead, hashes.size()); ++i)
+        zones.prefetch(hashes[i]);
+
+    vector<uint32_t> ids(zoneList.size());
+    for (size_t i = 0; i < zoneList.size(); ++i)
+    {
+        if (i + ahead < hashes.size())
+            zones.prefetch(hashes[i + ahead]);
+        ids[i] = zones.find(zoneList[i], hashes[i]);
+    }
+    return ids;
+}
+
+std::vector<long long> TripAnalyzer::countsForZones(const std::vector<std::string_view> &zoneList) const
+{
+    vector<long long> counts;
+    counts.reserve(zoneList.size());
+    for (uint32_t id : findZones(zoneList))
+        counts.push_back(id == ZoneDict::npos ? 0 : zoneStats[id].total);
+    return counts;
+}
+
+std::vector<long long> TripAnalyzer::countsForSlots(const std::vector<std::pair<std::string_view, int>> &slotList) const
+{
+    vector<string_view> zoneList;
+    zoneList.reserve(slotList.size());
+    for (const auto &slot : slotList)
+        zoneList.push_back(slot.first);
+    vector<uint32_t> ids = findZones(zoneList);
+
+    vector<long long> counts;
+    counts.reserve(slotList.size());
+    for (size_t i = 0; i < slotList.size(); ++i)
+    {
+        int hour = slotList[i].second;
+        bool known = ids[i] != ZoneDict::npos && hour >= 0 && hour < hoursPerDay;
+        counts.push_back(known ? zoneStats[ids[i]].hours[hour] : 0);
+    }
+    return counts;
+}
+
+void TripAnalyzer::setApproximate(size_t capacity)
+{
+    if (capacity == approxCapacity)
+        return;
+    ++generation;
+
+    SpaceSaving newZones(capacity), newSlots(capacity);
+    if (capacity == 0)
+    {
+        // Estimates can't be turned back into exact counts.
+    }
+    else if (approxCapacity)
+    {
+        // Resizing: replay the old summaries, errors included.
+        for (const auto &e : zoneSummary.all())
+            newZones.add(e.key, e.count, e.error);
+        for (const auto &e : slotSummary.all())
+            newSlots.add(e.key, e.count, e.error);
+    }
+    else
+    {
+        // Exact counts so far go in as weights with no error, then the exact tables are freed.
+        for (uint32_t id = 0; id < zoneStats.size(); ++id)
+        {
+            const ZoneStats &st = zoneStats[id];
+            newZones.add(zones.name(id), st.total);
+            for (int h = 0; h < hoursPerDay; ++h)
+            {
+                slotKey(slotKeyScratch, zones.name(id), h);
+                newSlots.add(slotKeyScratch, st.hours[h]);
+            }
+        }
+        zones = ZoneDict();
+        zoneStats = vector<ZoneStats>();
+    }
+
+    zoneSummary = std::move(newZones);
+    slotSummary = std::move(newSlots);
+    approxCapacity = capacity;
+    rebuildBoards();
+}
+
+void TripAnalyzer::ingestBuffer(std::string_view data, bool detectHeader)
+{
+    // The caller's bytes are parsed where they are, exactly like a mapped file.
+    bool headerHandled = !detectHeader;
+    if (!concurrent.shards.empty())
+    {
+        ingestSharded(data.data(), data.data() + data.size(), headerHandled);
+        return;
+    }
+    ++generation;
+    statAdd(ingestCounters.bytesRead, data.size());
+    reserveForIngest(data.size());
+    ingestRange(data.data(), data.data() + data.size(), headerHandled);
+}
+
+void TripAnalyzer::beginStream(bool detectHeader)
+{
+    streamTail.clear();
+    streamHeaderHandled = !detectHeader;
+    streaming = true;
+}
+
+void TripAnalyzer::feed(std::string_view chunk)
+{
+    if (!streaming)
+        beginStream();
+    ++generation;
+    statAdd(ingestCounters.bytesRead, chunk.size());
+
+    const char *p = chunk.data();
+    const char *end = p + chunk.size();
+
+    // Finish the line the previous chunk cut in half. Only this one line is ever copied.
+    if (!streamTail.empty())
+    {
+        const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!nl)
+        {
+            streamTail.append(p, end);
+            return;
+        }
+        streamTail.append(p, nl);
+        ingestLines(streamTail.data(), streamTail.data() + streamTail.size(), streamHeaderHandled);
+        streamTail.clear();
+        p = nl + 1;
+    }
+
+    // Every complete line is parsed straight out of the chunk, the unfinished last one waits for the next chunk.
+    const char *lastNl = p;
+    for (const char *q = end; q > p; --q)
+    {
+        if (q[-1] == '\n')
+        {
+            lastNl = q;
+            break;
+        }
+    }
+    if (lastNl > p)
+        ingestRange(p, lastNl, streamHeaderHandled);
+    streamTail.assign(lastNl, end);
+}
+
+void TripAnalyzer::endStream()
+{
+    // Like getline, a last line without '\n' still counts.
+    ++generation;
+    if (!streamTail.empty())
+        ingestLines(streamTail.data(), streamTail.data() + streamTail.size(), streamHeaderHandled);
+    streamTail.clear();
+    streaming = false;
+}
+
+// Maps csvPath read-only and calls onBytes(begin, end) on the whole file. Returns false if it isn't
+// a regular file or can't be mapped, so the caller can read it some other way.
+// wholeFile asks the kernel to read everything in at once instead of reading ahead sequentially.
+template <class OnBytes>
+static bool withMappedFile(const std::string &csvPath, bool wholeFile, OnBytes &&onBytes)
+{
+#ifdef TRIP_HAVE_MMAP
+    int fd = open(csvPath.c_str(), O_RDONLY);
+    if (fd < 0)
         return false;
 
-    // A clean up trailing spaces
-    const char *zoneEnd = p;
-    while (zoneEnd > zoneStart && (zoneEnd[-1] == ' ' || zoneEnd[-1] == '\t'))
-        --zoneEnd;
-    if (zoneStart == zoneEnd)
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
         return false;
+    }
 
-    zoneOut.assign(zoneStart, zoneEnd - zoneStart);
-    ++p; // skip comma
+    // Nothing to map for an empty file, and mmap would reject a zero length anyway.
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size == 0)
+    {
+        close(fd);
+        onBytes(nullptr, nullptr);
+        return true;
+    }
 
-    // 3We skip Column 2 the (DropoffZoneID) and then we don't need it for this analysis.
-    while (*p && *p != ',')
-        ++p;
-    if (!*p)
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps its own reference to the file
+    if (map == MAP_FAILED)
         return false;
-    ++p;
 
-    // 4Parse the hour from Column 3 the (PickupDateTime).
-    hourOut = parseHourFromDatetime(p);
-    if (hourOut < 0)
-        return false;
+    madvise(map, size, wholeFile ? MADV_WILLNEED : MADV_SEQUENTIAL);
+    const char *p = static_cast<const char *>(map);
+    onBytes(p, p + size);
 
-    return true; // success
+    munmap(map, size);
+    return true;
+#else
+    (void)csvPath;
+    (void)wholeFile;
+    (void)onBytes;
+    return false;
+#endif
 }
 
-// TRIP ANALYZER PART
-
 void TripAnalyzer::ingestFile(const std::string &csvPath)
 {
+    if (!concurrent.shards.empty())
+    {
+        // Inside a concurrent session nothing but the shards may be touched.
+        bool headerHandled = false;
+        auto shard = [this, &headerHandled](const char *p, const char *end) { ingestSharded(p, end, headerHandled); };
+        if (withMappedFile(csvPath, false, shard))
+            return;
+        ifstream file(csvPath);
+        if (!file.is_open())
+            return;
+        // Pipes and the like: gather lines into ~1 MB blocks, so the shards still get full batches.
+        string block, line;
+        while (getline(file, line))
+        {
+            block.append(line).push_back('\n');
+            if (block.size() >= TRIP_PIPELINE_BLOCK)
+            {
+                shard(block.data(), block.data() + block.size());
+                block.clear();
+            }
+        }
+        shard(block.data(), block.data() + block.size());
+        return;
+    }
+
+    // Regular files are walked in place through a mapping; pipes, devices and anything
+    // mmap refuses go through the plain getline loop below.
+    ++generation;
+    if (ingestMode == IngestMode::Pipelined)
+    {
+        if (ingestPipelined(csvPath))
+            return;
+    }
+    else if (ingestMode != IngestMode::Stream && ingestMapped(csvPath))
+    {
+        return;
+    }
+
     ifstream file(csvPath);
     if (!file.is_open())
         return;
 
-    // Tell the maps to clear out some space early so they don't have to rehash so often.
-    //  Reserve to reduce rehashing on large inputs.
-    zoneCount.reserve(100000);
-    slotCount.reserve(500000);
-
+    // No size to size the table from here (this is mostly pipes), it grows as zones show up.
     string line;
     bool headerHandled = false;
 
+    uint64_t readStart = statClock();
     while (getline(file, line))
     {
-        stripTrailingCR(line);
-        if (line.empty())
-            continue;
+        statAdd(ingestCounters.readNs, statClock() - readStart);
+        statAdd(ingestCounters.bytesRead, line.size() + (file.eof() ? 0 : 1));
+        ingestLines(line.data(), line.data() + line.size(), headerHandled);
+        readStart = statClock();
+    }
+}
+
+bool TripAnalyzer::ingestMapped(const std::string &csvPath)
+{
+    // Parallel workers each read their own slice, so hint the whole file in at once.
+    // Otherwise we read front to back exactly once, so let the kernel read ahead aggressively.
+    // The mapping's own page faults happen while parsing; only open/mmap/munmap count as reading.
+    uint64_t start = statClock(), inside = 0;
+    bool mapped = withMappedFile(csvPath, ingestMode == IngestMode::Parallel, [this, &inside](const char *p, const char *end)
+                                 {
+                                     uint64_t t = statClock();
+                                     statAdd(ingestCounters.bytesRead, static_cast<uint64_t>(end - p));
+                                     reserveForIngest(static_cast<size_t>(end - p));
+                                     bool headerHandled = false;
+                                     ingestRange(p, end, headerHandled);
+                                     inside += statClock() - t;
+                                 });
+    statAdd(ingestCounters.readNs, statClock() - start - inside);
+    return mapped;
+}
 
-        // Skip the very first line if it contains TripID (the headers of it).
-        if (!headerHandled)
+namespace
+{
+// (zone, hour) of an accepted row, pointing into the bytes it was parsed from.
+struct ParsedRow
+{
+    string_view zone;
+    int hour;
+};
+}
+
+// Calls onRow(zone, hour) for every accepted row of [p, end), and tallies every data line in stats.
+// Lines are split exactly like getline would, with the SIMD scanner if scan is set and the plain
+// byte loops otherwise.
+template <class OnRow>
+static inline void forEachRow(const char *p, const char *end, bool &headerHandled, LineScanFn scan, IngestStats &stats,
+                              OnRow &&onRow)
+{
+    string_view zone;
+    int hour = -1;
+    if (!scan)
+    {
+        while (p < end)
         {
-            headerHandled = true;
+            // Same split as getline: up to '\n', and the last line may have no '\n' at all.
+            const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+            const char *lineEnd = nl ? nl : end;
+            if (isDataLine(p, lineEnd, headerHandled) && tallyRow(stats, parseRow6(p, lineEnd, zone, hour), p, lineEnd))
+                onRow(zone, hour);
+            p = nl ? nl + 1 : end;
+        }
+        return;
+    }
 
-            if (line.find("TripID") != string::npos)
-                continue;
+    // SIMD path: one scan finds the end of the line and its commas together.
+    while (p < end)
+    {
+        LineScan ls;
+        scan(p, end, ls);
+        // Same fields as parseRow6, just sliced off the comma positions the scanner already found.
+        const char *lineEnd = ls.end;
+        if (isDataLine(p, lineEnd, headerHandled) && tallyRow(stats, parseScannedRow(ls, zone, hour), p, lineEnd))
+            onRow(zone, hour);
+        p = ls.end < end ? ls.end + 1 : end;
+    }
+}
 
-            // Backup check: if first field isn't a digit, it's probably a header row
-            const char *p = line.c_str();
-            while (*p == ' ' || *p == '\t')
-                ++p;
-            if (!isdigit(static_cast<unsigned char>(*p)))
+void TripAnalyzer::ingestLines(const char *p, const char *end, bool &headerHandled)
+{
+    LineScanFn scan = lineScanFor(resolveRowScanner(rowScanner));
+#if TRIP_STATS
+    // Reading the clock around every row would cost more than the row, so the rows of ~64 KB are
+    // parsed into a batch first and then counted, and each half is timed as a whole.
+    thread_local vector<ParsedRow> batch;
+    const size_t sliceBytes = 64 * 1024;
+    IngestStats &st = ingestCounters;
+    while (p < end)
+    {
+        const char *stop = end;
+        if (static_cast<size_t>(end - p) > sliceBytes)
+        {
+            const char *nl = static_cast<const char *>(memchr(p + sliceBytes, '\n', end - p - sliceBytes));
+            stop = nl ? nl + 1 : end;
+        }
+        uint64_t parseStart = statClock();
+        batch.clear();
+        forEachRow(p, stop, headerHandled, scan, st, [](string_view zone, int hour) { batch.push_back({zone, hour}); });
+        uint64_t countStart = statClock();
+        uint64_t rehashBefore = st.rehashNs;
+        for (const ParsedRow &row : batch)
+            countTrip(row.zone, row.hour);
+        st.parseNs += countStart - parseStart;
+        st.aggregateNs += statClock() - countStart - (st.rehashNs - rehashBefore);
+        p = stop;
+    }
+#else
+    forEachRow(p, end, headerHandled, scan, ingestCounters, [this](string_view zone, int hour) { countTrip(zone, hour); });
+#endif
+}
+
+// One block of the file on its way through IngestMode::Pipelined. The reader fills bytes with whole
+// lines only, the parser appends a record per accepted row, the caller counts them and hands the
+// block back to the reader. The records point into bytes, so a block is only refilled once it is back.
+namespace
+{
+struct PipelineBlock
+{
+    vector<char> bytes;
+    size_t size = 0;
+    vector<ParsedRow> rows;
+};
+}
+
+bool TripAnalyzer::ingestPipelined(const std::string &csvPath)
+{
+    ifstream file(csvPath, ios::binary);
+    if (!file.is_open())
+        return false;
+
+    // Four blocks in flight: one being read, one being parsed, one being counted and one spare.
+    // Every ring has room for all of them plus the end marker, so a push never has to wait.
+    const size_t blockBytes = TRIP_PIPELINE_BLOCK;
+    const size_t poolSize = 4;
+    vector<PipelineBlock> pool(poolSize);
+    SpscRing<PipelineBlock *> toParse(poolSize + 1), toCount(poolSize + 1), spare(poolSize + 1);
+    for (PipelineBlock &b : pool)
+        spare.tryPush(&b);
+
+    // Only set if a stage thread can't be started, so the other one gives up instead of waiting forever.
+    atomic<bool> cancelled{false};
+    auto pop = [&cancelled](SpscRing<PipelineBlock *> &ring, PipelineBlock *&out)
+    {
+        while (!ring.tryPop(out))
+        {
+            if (cancelled.load(memory_order_relaxed))
+                return false;
+            this_thread::yield();
+        }
+        return true;
+    };
+
+    // Stage 1: big sequential reads. The unfinished last line of a block is moved to the front of the
+    // next one before the block is passed on; nullptr marks the end of the file.
+    // Every stage keeps its own stats, they are added in once the threads are done.
+    IngestStats readerStats, parserStats;
+    auto reader = [&]()
+    {
+        PipelineBlock *cur;
+        if (!pop(spare, cur))
+            return;
+        size_t carry = 0;
+        for (;;)
+        {
+            if (cur->bytes.size() < carry + blockBytes)
+                cur->bytes.resize(carry + blockBytes);
+            uint64_t readStart = statClock();
+            file.read(cur->bytes.data() + carry, static_cast<streamsize>(blockBytes));
+            size_t got = static_cast<size_t>(file.gcount());
+            statAdd(readerStats.readNs, statClock() - readStart);
+            statAdd(readerStats.bytesRead, got);
+            size_t filled = carry + got;
+            if (got < blockBytes)
+            {
+                // End of file (or a read error, which Stream would treat the same way).
+                cur->size = filled;
+                toParse.tryPush(cur);
+                toParse.tryPush(nullptr);
+                return;
+            }
+
+            size_t keep = filled;
+            while (keep > 0 && cur->bytes[keep - 1] != '\n')
+                --keep;
+            if (keep == 0)
+            {
+                // One line longer than the block: keep reading into this block until it ends.
+                carry = filled;
                 continue;
+            }
 
-            // else: treat first line as data (fall through to parse)
+            PipelineBlock *next;
+            if (!pop(spare, next))
+                return;
+            carry = filled - keep;
+            if (next->bytes.size() < carry + blockBytes)
+                next->bytes.resize(carry + blockBytes);
+            memcpy(next->bytes.data(), cur->bytes.data() + keep, carry);
+            cur->size = keep;
+            toParse.tryPush(cur);
+            cur = next;
         }
+    };
 
-        string zone;
-        int hour = -1;
+    // Stage 2: split the rows and keep (zone, hour) of the accepted ones, same rules as ingestLines.
+    LineScanFn scan = lineScanFor(resolveRowScanner(rowScanner));
+    auto parser = [&]()
+    {
+        bool headerHandled = false;
+        PipelineBlock *b;
+        while (pop(toParse, b))
+        {
+            if (b)
+            {
+                uint64_t parseStart = statClock();
+                b->rows.clear();
+                const char *p = b->bytes.data();
+                forEachRow(p, p + b->size, headerHandled, scan, parserStats,
+                           [b](string_view zone, int hour) { b->rows.push_back({zone, hour}); });
+                statAdd(parserStats.parseNs, statClock() - parseStart);
+            }
+            toCount.tryPush(b);
+            if (!b)
+                return;
+        }
+    };
 
-        // Pull the data we need out of the line.
-        if (!parseRow6(line, zone, hour))
-            continue;
+    thread readerThread, parserThread;
+    try
+    {
+        readerThread = thread(reader);
+        parserThread = thread(parser);
+    }
+    catch (const system_error &)
+    {
+        // Nothing has been counted yet, so the caller can just stream the file from the start.
+        cancelled = true;
+        if (readerThread.joinable())
+            readerThread.join();
+        return false;
+    }
 
-        // tally things up:
-        zoneCount[zone] += 1;         // This zone just got another trip.
-        slotCount[{zone, hour}] += 1; // This specific zone at this specific hour just got another trip to tally.
+    // Stage 3, on the calling thread: count, then give the block back to the reader.
+    PipelineBlock *b;
+    while (pop(toCount, b) && b)
+    {
+        uint64_t countStart = statClock();
+        uint64_t rehashBefore = ingestCounters.rehashNs;
+        for (const ParsedRow &row : b->rows)
+            countTrip(row.zone, row.hour);
+        statAdd(ingestCounters.aggregateNs, statClock() - countStart - (ingestCounters.rehashNs - rehashBefore));
+        spare.tryPush(b);
     }
+
+    readerThread.join();
+    parserThread.join();
+#if TRIP_STATS
+    ingestCounters += readerStats;
+    ingestCounters += parserStats;
+#endif
+    return true;
 }
 
-std::vector<ZoneCount> TripAnalyzer::topZones(int k) const
+void TripAnalyzer::ingestRange(const char *p, const char *end, bool &headerHandled)
 {
-    vector<ZoneCount> result;
-    result.reserve(zoneCount.size());
+    if (ingestMode == IngestMode::Parallel)
+        ingestParallel(p, end, headerHandled);
+    else
+        ingestLines(p, end, headerHandled);
+}
 
-    // Dump the map data into a list, flat structure so we can sort it.
-    for (const auto &it : zoneCount)
-        result.push_back({it.first, it.second});
+void TripAnalyzer::ingestParallel(const char *p, const char *end, bool &headerHandled)
+{
+    // The header rule only looks at the first non-empty line of the file, so settle it here
+    // before splitting. After this every chunk is plain data, even if it starts with a blank line.
+    while (p < end && !headerHandled)
+    {
+        const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+        ingestLine(p, nl ? nl : end, headerHandled);
+        p = nl ? nl + 1 : end;
+    }
 
-    // For Tie breakers
-    // 1The higher count wins 2If counts are equal, the lexicographically smaller zone get priority to come first.
-    auto cmp = [](const ZoneCount &a, const ZoneCount &b)
+    unsigned threads = threadCount ? threadCount : thread::hardware_concurrency();
+    // Small files aren't worth a thread start, give every worker at least ~1 MB to chew on.
+    const size_t minChunk = TRIP_PARALLEL_MIN_CHUNK;
+    size_t bytes = static_cast<size_t>(end - p);
+    threads = static_cast<unsigned>(min<size_t>(max(threads, 1u), bytes / minChunk + 1));
+    if (threads <= 1)
     {
-        if (a.count != b.count)
-            return a.count > b.count;
-        return a.zone < b.zone;
+        ingestLines(p, end, headerHandled);
+        return;
+    }
+
+    // Cut the file into roughly equal byte ranges, then push every cut forward to the start of
+    // the next line so no row is split between two workers.
+    vector<const char *> cuts(threads + 1);
+    cuts[0] = p;
+    cuts[threads] = end;
+    for (unsigned i = 1; i < threads; ++i)
+    {
+        const char *c = max(p + bytes / threads * i, cuts[i - 1]);
+        const char *nl = static_cast<const char *>(memchr(c, '\n', end - c));
+        cuts[i] = nl ? nl + 1 : end;
+    }
+
+    // Chunk 0 is counted straight into this analyzer on the calling thread, the others into
+    // their own partial analyzers so the workers never share a map.
+    vector<TripAnalyzer> parts(threads - 1);
+    vector<thread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; ++i)
+    {
+        TripAnalyzer &part = parts[i - 1];
+        copySettings(part);
+        const char *b = cuts[i];
+        const char *e = cuts[i + 1];
+        auto work = [&part, b, e]()
+        {
+            bool handled = true;
+            part.ingestLines(b, e, handled);
+        };
+        try
+        {
+            workers.emplace_back(work);
+        }
+        catch (const system_error &)
+        {
+            // Out of threads: just do this chunk ourselves, the result is the same.
+            work();
+        }
+    }
+
+    ingestLines(cuts[0], cuts[1], headerHandled);
+
+    for (auto &w : workers)
+        w.join();
+    for (auto &part : parts)
+        absorb(std::move(part));
+    // Chunk 0 kept the leaderboards current, the absorbed chunks didn't.
+    rebuildBoards();
+}
+
+void TripAnalyzer::copySettings(TripAnalyzer &part) const
+{
+    part.rowScanner = rowScanner;
+    part.setApproximate(approxCapacity);
+    part.setSketch(zoneSketch.width(), zoneSketch.depth(), exactCounts);
+}
+
+void TripAnalyzer::beginConcurrent(unsigned shards)
+{
+    endConcurrent();
+    unsigned wanted = shards ? shards : 4 * max(thread::hardware_concurrency(), 1u);
+    unsigned bits = 0;
+    while ((1u << bits) < wanted && bits < 16)
+        ++bits;
+
+    concurrent.bits = bits;
+    concurrent.shards.resize(size_t(1) << bits);
+    for (auto &shard : concurrent.shards)
+    {
+        shard = make_unique<Shard>();
+        shard->counts = make_unique<TripAnalyzer>();
+        copySettings(*shard->counts);
+    }
+}
+
+void TripAnalyzer::endConcurrent()
+{
+    if (concurrent.shards.empty())
+        return;
+    ++generation;
+    // The shards hold disjoint sets of zones, so folding them in is the same as a merge.
+    vector<unique_ptr<Shard>> shards = std::move(concurrent.shards);
+    concurrent.shards.clear();
+    concurrent.bits = 0;
+    for (auto &shard : shards)
+        absorb(std::move(*shard->counts));
+    rebuildBoards();
+}
+
+void TripAnalyzer::ingestSharded(const char *p, const char *end, bool &headerHandled) const
+{
+    // Rows waiting for their shard. They point into [p, end), so everything is flushed before we return;
+    // the vectors themselves stay with the thread so steady-state calls don't allocate.
+    const size_t batchRows = 1024;
+    thread_local vector<vector<ParsedRow>> pending;
+    const unsigned bits = concurrent.bits;
+    const size_t shardCount = concurrent.shards.size();
+    if (pending.size() < shardCount)
+        pending.resize(shardCount);
+    IngestStats local;
+    uint64_t start = statClock(), countedNs = 0;
+
+    // A full batch only waits for its shard once it has grown well past full: until then a busy shard
+    // is skipped and tried again later, so a hot zone doesn't make every producer queue up behind it.
+    auto flush = [&](size_t i, bool wait)
+    {
+        Shard &shard = *concurrent.shards[i];
+        unique_lock<mutex> guard(shard.lock, defer_lock);
+        if (wait)
+            guard.lock();
+        else if (!guard.try_lock())
+            return;
+        uint64_t countStart = statClock();
+        uint64_t rehashBefore = shard.counts->ingestCounters.rehashNs;
+        for (const ParsedRow &row : pending[i])
+            shard.counts->countTrip(row.zone, row.hour);
+        pending[i].clear();
+        uint64_t counted = statClock() - countStart;
+        statAdd(local.aggregateNs, counted - (shard.counts->ingestCounters.rehashNs - rehashBefore));
+        countedNs += counted;
     };
 
-    if ((int)result.size() > k)
+    LineScanFn scan = lineScanFor(resolveRowScanner(rowScanner));
+    forEachRow(p, end, headerHandled, scan, local, [&](string_view zone, int hour)
+               {
+                   size_t i = bits ? static_cast<size_t>(ZoneDict::hash(zone) >> (64 - bits)) : 0;
+                   vector<ParsedRow> &rows = pending[i];
+                   rows.push_back({zone, hour});
+                   if (rows.size() >= batchRows)
+                       flush(i, rows.size() >= 8 * batchRows);
+               });
+    for (size_t i = 0; i < shardCount; ++i)
+        if (!pending[i].empty())
+            flush(i, true);
+
+    // Parsing is whatever wasn't spent counting.
+    statAdd(local.bytesRead, static_cast<uint64_t>(end - p));
+    statAdd(local.parseNs, statClock() - start - countedNs);
+#if TRIP_STATS
+    // The call's stats wait in shard 0 until endConcurrent folds the shards in.
+    Shard &first = *concurrent.shards[0];
+    lock_guard<mutex> guard(first.lock);
+    first.counts->ingestCounters += local;
+#endif
+}
+
+bool TripAnalyzer::merge(TripAnalyzer &&other)
+{
+    if (&other == this)
+        return merge(static_cast<const TripAnalyzer &>(other));
+    if (!adoptSketchOnly(other))
+        return false;
+    ++generation;
+    absorb(std::move(other));
+    rebuildBoards();
+    return true;
+}
+
+bool TripAnalyzer::merge(const TripAnalyzer &other)
+{
+    if (!adoptSketchOnly(other))
+        return false;
+    ++generation;
+    addCounts(other);
+    rebuildBoards();
+    return true;
+}
+
+bool TripAnalyzer::adoptSketchOnly(const TripAnalyzer &other)
+{
+    // A sketch-only analyzer's rows are only in its sketch, so this side has to switch to the same sketch
+    // and stop counting exactly, the way merging summaries makes it approximate.
+    if (other.exactCounts || other.zoneSketch.total() == 0)
+        return true;
+    if (zoneSketch.sameShape(other.zoneSketch))
+    {
+        // Every row we counted is already in our sketch.
+        if (exactCounts)
+            freeExactTables();
+        return true;
+    }
+    // Summaries can't be turned into a sketch; a sketch-only side of another shape is refused by setSketch.
+    if (approxCapacity)
+        return false;
+    return setSketch(other.zoneSketch.width(), other.zoneSketch.depth(), false);
+}
+
+void TripAnalyzer::absorb(TripAnalyzer &&other)
+{
+    // Fold the smaller side into the bigger one: swap storage first if the other side has more
+    // zones, so only the smaller dictionary is re-interned. Into an empty analyzer this is a plain steal.
+    bool sameLayout = !approxCapacity && !other.approxCapacity && exactCounts && zoneSketch.sameShape(other.zoneSketch);
+    if (sameLayout && other.zones.size() > zones.size())
+    {
+        swap(zones, other.zones);
+        swap(zoneStats, other.zoneStats);
+    }
+    addCounts(other);
+
+    other.zones = ZoneDict();
+    other.zoneStats.clear();
+    other.zoneSummary.clear();
+    other.slotSummary.clear();
+    other.zoneSketch.clear();
+    other.slotSketch.clear();
+    other.ingestCounters = IngestStats();
+    ++other.generation;
+    other.rebuildBoards();
+}
+
+void TripAnalyzer::addCounts(const TripAnalyzer &other)
+{
+#if TRIP_STATS
+    ingestCounters += other.ingestCounters;
+#endif
+    // Sketches of the same shape just add up; otherwise the other side's exact counts go in as weights.
+    if (zoneSketch.sameShape(other.zoneSketch))
+    {
+        zoneSketch.addSketch(other.zoneSketch);
+        slotSketch.addSketch(other.slotSketch);
+    }
+    else
+    {
+        sketchCounts(other);
+    }
+
+    if (approxCapacity || other.approxCapacity)
+    {
+        // Summaries merge by adding every entry with its error, which keeps both bounds valid.
+        if (!approxCapacity)
+            setApproximate(other.approxCapacity);
+        for (uint32_t id = 0; id < other.zoneStats.size(); ++id)
+        {
+            const ZoneStats &theirs = other.zoneStats[id];
+            zoneSummary.add(other.zones.name(id), theirs.total);
+            for (int h = 0; h < hoursPerDay; ++h)
+            {
+                slotKey(slotKeyScratch, other.zones.name(id), h);
+                slotSummary.add(slotKeyScratch, theirs.hours[h]);
+            }
+        }
+        for (const auto &e : other.zoneSummary.all())
+            zoneSummary.add(e.key, e.count, e.error);
+        for (const auto &e : other.slotSummary.all())
+            slotSummary.add(e.key, e.count, e.error);
+        return;
+    }
+    if (!exactCounts)
+        return;
+
+    // Counts are plain sums, so the order the partials are folded in never changes the result.
+    // The other analyzer numbered its zones on its own, so every id is translated through our dictionary.
+    for (uint32_t id = 0; id < other.zones.size(); ++id)
+    {
+        ZoneStats &mine = statsFor(internZone(other.zones.name(id)));
+        const ZoneStats &theirs = other.zoneStats[id];
+        mine.total += theirs.total;
+        for (int h = 0; h < hoursPerDay; ++h)
+            mine.hours[h] += theirs.hours[h];
+    }
+}
+
+TripAnalyzer::ZoneStats &TripAnalyzer::statsFor(uint32_t id)
+{
+    // Ids are handed out densely, so a brand new zone is always exactly one past the end.
+    if (id == zoneStats.size())
+    {
+        bool moves = !zoneStats.empty() && zoneStats.size() == zoneStats.capacity();
+        timedRehash(ingestCounters, moves, [this]() { zoneStats.emplace_back(); });
+    }
+    return zoneStats[id];
+}
+
+void TripAnalyzer::reserveForIngest(size_t bytes)
+{
+    if (approxCapacity)
+        return; // the summaries are allocated up front
+    if (!exactCounts)
+        return; // sketch only: the exact tables stay empty
+    // Tell the maps to clear out some space early so they don't have to rehash so often.
+    // A row is rarely shorter than ~48 bytes, so that bounds how many new zones this input can add.
+    // Past 100k the table just keeps doubling; that's cheap enough to not pre-pay for it.
+    // A later input mostly repeats zones we already have, so its bound is not added on top of them:
+    // reserving size + bound on every call would reallocate the tables on every ingestBuffer.
+    size_t rowsUpperBound = bytes / 48 + 1;
+    size_t wanted = max<size_t>(zones.size(), min<size_t>(rowsUpperBound, 100000));
+    bool moves = (zones.size() > 0 && zones.reserveGrows(wanted)) || (!zoneStats.empty() && zoneStats.capacity() < wanted);
+    timedRehash(ingestCounters, moves, [this, wanted]()
+                {
+                    zones.reserve(wanted);
+                    zoneStats.reserve(wanted);
+                });
+}
+
+void TripAnalyzer::ingestLine(const char *s, const char *e, bool &headerHandled)
+{
+    if (!isDataLine(s, e, headerHandled))
+        return;
+
+    string_view zone;
+    int hour = -1;
+
+    // Pull the data we need out of the line.
+    if (!tallyRow(ingestCounters, parseRow6(s, e, zone, hour), s, e))
+        return;
+
+    countTrip(zone, hour);
+}
+
+inline uint32_t TripAnalyzer::internZone(string_view zone)
+{
+    uint32_t id;
+    timedRehash(ingestCounters, zones.size() > 0 && zones.internGrows(), [&]() { id = zones.intern(zone); });
+    return id;
+}
+
+inline void TripAnalyzer::countTrip(string_view zone, int hour)
+{
+    if (zoneSketch.enabled())
+    {
+        uint64_t h = ZoneDict::hash(zone);
+        zoneSketch.add(h);
+        slotSketch.add(CountMinSketch::combine(h, hour));
+    }
+    if (approxCapacity)
+    {
+        countApprox(zone, hour);
+        return;
+    }
+    if (!exactCounts)
+        return;
+
+    // tally things up:
+    // Only a zone we have never seen before costs a string copy, every other row is an id lookup.
+    uint32_t id = internZone(zone);
+    ZoneStats &st = statsFor(id);
+
+    st.total += 1;       // This zone just got another trip.
+    st.hours[hour] += 1; // This specific zone at this specific hour just got another trip to tally.
+
+    if (boardCapacity)
+    {
+        if (id >= boardBits.size())
+            boardBits.resize(zoneStats.size());
+        boardUpdate(zoneBoard, {st.total, id, -1}, id, zoneBoardBit);
+        boardUpdate(slotBoard, {st.hours[hour], id, hour}, uint64_t(id) * hoursPerDay + hour, 1u << hour);
+    }
+}
+
+void TripAnalyzer::countApprox(string_view zone, int hour)
+{
+    zoneSummary.add(zone);
+    slotKey(slotKeyScratch, zone, hour);
+    slotSummary.add(slotKeyScratch);
+}
+
+void TripAnalyzer::slotKey(std::string &out, std::string_view zone, int hour)
+{
+    out.assign(zone.data(), zone.size());
+    out.push_back(static_cast<char>(hour));
+}
+
+// Same order as topZones / topBusySlots: count descending, then zone name, then hour.
+bool TripAnalyzer::boardBetter(const BoardEntry &a, const BoardEntry &b) const
+{
+    if (a.count != b.count)
+        return a.count > b.count;
+    if (a.id != b.id)
+        return zones.name(a.id) < zones.name(b.id);
+    return a.hour < b.hour;
+}
+
+// e just gained one trip. A member bubbles up; an outsider gets in if there is room or it now beats
+// the last member, which drops out. Nothing else can change rank, so the board stays the exact top.
+void TripAnalyzer::boardUpdate(Leaderboard &board, const BoardEntry &e, uint64_t key, uint32_t bit)
+{
+    vector<BoardEntry> &entries = board.entries;
+    size_t i;
+    if (boardBits[e.id] & bit)
+    {
+        i = board.pos[key];
+        entries[i].count = e.count;
+    }
+    else if (entries.size() < boardCapacity)
     {
-        // Here we only nned the top K so partial_sort is more efficient if we sorted the whole list.
-        partial_sort(result.begin(), result.begin() + k, result.end(), cmp);
-        result.resize(k);
+        i = entries.size();
+        entries.push_back(e);
+    }
+    else if (boardBetter(e, entries.back()))
+    {
+        BoardEntry &last = entries.back();
+        uint32_t lastBit = last.hour < 0 ? zoneBoardBit : 1u << last.hour;
+        boardBits[last.id] &= ~lastBit;
+        // The dropped member's index node is handed to the new one, so a full board never allocates.
+        auto node = board.pos.extract(last.hour < 0 ? uint64_t(last.id) : uint64_t(last.id) * hoursPerDay + last.hour);
+        node.key() = key;
+        board.pos.insert(std::move(node));
+        i = entries.size() - 1;
+        last = e;
     }
     else
     {
-        sort(result.begin(), result.end(), cmp);
+        return;
+    }
+    boardBits[e.id] |= bit;
+
+    for (; i > 0 && boardBetter(entries[i], entries[i - 1]); --i)
+    {
+        swap(entries[i], entries[i - 1]);
+        const BoardEntry &moved = entries[i];
+        board.pos[moved.hour < 0 ? uint64_t(moved.id) : uint64_t(moved.id) * hoursPerDay + moved.hour] = static_cast<uint32_t>(i);
+    }
+    board.pos[key] = static_cast<uint32_t>(i);
+}
+
+// Keeps the k best items seen so far. The heap's front is the worst of them, so a new item only has
+// to beat that one to get in: O(m log k) for m items and never more than k of them in memory.
+// better(a, b) is true if a ranks before b; sorted() hands the winners back best first.
+template <class T, class Better>
+struct BoundedTopK
+{
+    size_t k;
+    Better better;
+    vector<T> heap;
+
+    BoundedTopK(size_t k, Better better) : k(k), better(better) { heap.reserve(k); }
+
+    void offer(const T &item)
+    {
+        if (heap.size() < k)
+        {
+            heap.push_back(item);
+            push_heap(heap.begin(), heap.end(), better);
+        }
+        else if (k > 0 && better(item, heap.front()))
+        {
+            pop_heap(heap.begin(), heap.end(), better);
+            heap.back() = item;
+            push_heap(heap.begin(), heap.end(), better);
+        }
+    }
+
+    vector<T> sorted()
+    {
+        sort_heap(heap.begin(), heap.end(), better);
+        return std::move(heap);
+    }
+};
+
+template <class T, class Better>
+static BoundedTopK<T, Better> makeTopK(size_t k, Better better)
+{
+    return BoundedTopK<T, Better>(k, better);
+}
+
+void TripAnalyzer::rebuildBoards()
+{
+    zoneBoard.entries.clear();
+    zoneBoard.pos.clear();
+    slotBoard.entries.clear();
+    slotBoard.pos.clear();
+    boardBits.assign(boardCapacity ? zoneStats.size() : 0, 0);
+    if (!boardCapacity)
+        return;
+
+    auto better = [this](const BoardEntry &a, const BoardEntry &b) { return boardBetter(a, b); };
+    auto topZ = makeTopK<BoardEntry>(min(boardCapacity, zoneStats.size()), better);
+    auto topS = makeTopK<BoardEntry>(min(boardCapacity, zoneStats.size() * hoursPerDay), better);
+    for (uint32_t id = 0; id < zoneStats.size(); ++id)
+    {
+        const ZoneStats &st = zoneStats[id];
+        topZ.offer({st.total, id, -1});
+        for (int h = 0; h < hoursPerDay; ++h)
+            if (st.hours[h] != 0)
+                topS.offer({st.hours[h], id, h});
+    }
+
+    zoneBoard.entries = topZ.sorted();
+    for (uint32_t i = 0; i < zoneBoard.entries.size(); ++i)
+    {
+        const BoardEntry &e = zoneBoard.entries[i];
+        zoneBoard.pos[e.id] = i;
+        boardBits[e.id] |= zoneBoardBit;
+    }
+    slotBoard.entries = topS.sorted();
+    for (uint32_t i = 0; i < slotBoard.entries.size(); ++i)
+    {
+        const BoardEntry &e = slotBoard.entries[i];
+        slotBoard.pos[uint64_t(e.id) * hoursPerDay + e.hour] = i;
+        boardBits[e.id] |= 1u << e.hour;
+    }
+}
+
+std::vector<ZoneCount> TripAnalyzer::topZones(int k) const
+{
+    if (k <= 0)
+        return {};
+
+    // Incremental mode: the leaderboard already holds the answer in order.
+    if (static_cast<size_t>(k) <= boardCapacity && !approxCapacity)
+    {
+        vector<ZoneCount> result;
+        size_t n = min(static_cast<size_t>(k), zoneBoard.entries.size());
+        result.reserve(n);
+        for (size_t i = 0; i < n; ++i)
+            result.push_back({string(zones.name(zoneBoard.entries[i].id)), zoneBoard.entries[i].count});
+        return result;
+    }
+
+    lock_guard<mutex> guard(cache.lock);
+    if (cache.generation != generation)
+    {
+        cache.zones.clear();
+        cache.slots.clear();
+        cache.generation = generation;
+    }
+    auto hit = cache.zones.find(k);
+    if (hit != cache.zones.end())
+        return hit->second;
+    if (cache.zones.size() >= maxCachedK)
+        cache.zones.clear();
+    return cache.zones[k] = scanTopZones(static_cast<size_t>(k));
+}
+
+std::vector<ZoneCount> TripAnalyzer::scanTopZones(size_t k) const
+{
+    if (approxCapacity)
+    {
+        vector<ZoneCount> result;
+        for (auto &e : approxZones(k))
+            result.push_back({std::move(e.zone), e.count});
+        return result;
     }
+
+    // Candidates are just (count, id): the scan compares names in place and never copies one.
+    struct Entry
+    {
+        long long count;
+        uint32_t id;
+    };
+
+    // For Tie breakers
+    // 1The higher count wins 2If counts are equal, the lexicographically smaller zone get priority to come first.
+    auto better = [this](const Entry &a, const Entry &b)
+    {
+        if (a.count != b.count)
+            return a.count > b.count;
+        return zones.name(a.id) < zones.name(b.id);
+    };
+
+    auto top = makeTopK<Entry>(min<size_t>(k, zoneStats.size()), better);
+    for (uint32_t id = 0; id < zoneStats.size(); ++id)
+        top.offer({zoneStats[id].total, id});
+
+    // Zone names are only turned back into strings here, for the k winners.
+    vector<ZoneCount> result;
+    result.reserve(top.heap.size());
+    for (const Entry &e : top.sorted())
+        result.push_back({string(zones.name(e.id)), e.count});
     return result;
 }
 
 // K is being returned busiest time slots.
 std::vector<SlotCount> TripAnalyzer::topBusySlots(int k) const
 {
-    vector<SlotCount> result;
-    result.reserve(slotCount.size());
+    if (k <= 0)
+        return {};
+
+    if (static_cast<size_t>(k) <= boardCapacity && !approxCapacity)
+    {
+        vector<SlotCount> result;
+        size_t n = min(static_cast<size_t>(k), slotBoard.entries.size());
+        result.reserve(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            const BoardEntry &e = slotBoard.entries[i];
+            result.push_back({string(zones.name(e.id)), e.hour, e.count});
+        }
+        return result;
+    }
 
-    for (const auto &it : slotCount)
+    lock_guard<mutex> guard(cache.lock);
+    if (cache.generation != generation)
     {
-        result.push_back({it.first.first, it.first.second, it.second});
+        cache.zones.clear();
+        cache.slots.clear();
+        cache.generation = generation;
     }
+    auto hit = cache.slots.find(k);
+    if (hit != cache.slots.end())
+        return hit->second;
+    if (cache.slots.size() >= maxCachedK)
+        cache.slots.clear();
+    return cache.slots[k] = scanTopSlots(static_cast<size_t>(k));
+}
+
+std::vector<SlotCount> TripAnalyzer::scanTopSlots(size_t k) const
+{
+    if (approxCapacity)
+    {
+        vector<SlotCount> result;
+        for (auto &e : approxSlots(k))
+            result.push_back({std::move(e.zone), e.hour, e.count});
+        return result;
+    }
+
+    struct Entry
+    {
+        long long count;
+        uint32_t id;
+        int hour;
+    };
 
     // this is a tie breaker for sloting first, then Zone Name, then Hour.
-    auto cmp = [](const SlotCount &a, const SlotCount &b)
+    auto better = [this](const Entry &a, const Entry &b)
     {
         if (a.count != b.count)
             return a.count > b.count;
-        if (a.zone != b.zone)
-            return a.zone < b.zone;
+        if (a.id != b.id)
+            return zones.name(a.id) < zones.name(b.id);
         return a.hour < b.hour;
     };
 
-    if ((int)result.size() > k)
+    auto top = makeTopK<Entry>(min<size_t>(k, zoneStats.size() * hoursPerDay), better);
+
+    // One flat pass over every zone's 24 counters, empty hours are not slots.
+    for (uint32_t id = 0; id < zoneStats.size(); ++id)
     {
-        // Again here we use partial_sort to save time.
-        partial_sort(result.begin(), result.begin() + k, result.end(), cmp);
-        result.resize(k);
+        const ZoneStats &st = zoneStats[id];
+        for (int h = 0; h < hoursPerDay; ++h)
+            if (st.hours[h] != 0)
+                top.offer({st.hours[h], id, h});
     }
-    else
+
+    vector<SlotCount> result;
+    result.reserve(top.heap.size());
+    for (const Entry &e : top.sorted())
+        result.push_back({string(zones.name(e.id)), e.hour, e.count});
+    return result;
+}
+
+std::vector<ApproxZoneCount> TripAnalyzer::topZonesWithError(int k) const
+{
+    if (k <= 0)
+        return {};
+    if (approxCapacity)
+        return approxZones(static_cast<size_t>(k));
+
+    vector<ApproxZoneCount> result;
+    for (auto &z : topZones(k))
+        result.push_back({std::move(z.zone), z.count, 0});
+    return result;
+}
+
+std::vector<ApproxSlotCount> TripAnalyzer::topBusySlotsWithError(int k) const
+{
+    if (k <= 0)
+        return {};
+    if (approxCapacity)
+        return approxSlots(static_cast<size_t>(k));
+
+    vector<ApproxSlotCount> result;
+    for (auto &s : topBusySlots(k))
+        result.push_back({std::move(s.zone), s.hour, s.count, 0});
+    return result;
+}
+
+// Estimated counts rank the summary entries, with the same tie breakers as the exact results.
+std::vector<ApproxZoneCount> TripAnalyzer::approxZones(size_t k) const
+{
+    const vector<SpaceSaving::Entry> &all = zoneSummary.all();
+    auto better = [&all](uint32_t a, uint32_t b)
     {
-        sort(result.begin(), result.end(), cmp);
-    }
+        if (all[a].count != all[b].count)
+            return all[a].count > all[b].count;
+        return all[a].key < all[b].key;
+    };
+
+    auto top = makeTopK<uint32_t>(min(k, all.size()), better);
+    for (uint32_t i = 0; i < all.size(); ++i)
+        top.offer(i);
+
+    vector<ApproxZoneCount> result;
+    result.reserve(top.heap.size());
+    for (uint32_t i : top.sorted())
+        result.push_back({all[i].key, all[i].count, all[i].error});
+    return result;
+}
+
+std::vector<ApproxSlotCount> TripAnalyzer::approxSlots(size_t k) const
+{
+    // Keys are zone + hour byte, so the zone is everything but the last byte.
+    const vector<SpaceSaving::Entry> &all = slotSummary.all();
+    auto zoneOf = [&all](uint32_t i) { return string_view(all[i].key).substr(0, all[i].key.size() - 1); };
+    auto hourOf = [&all](uint32_t i) { return static_cast<int>(all[i].key.back()); };
+    auto better = [&](uint32_t a, uint32_t b)
+    {
+        if (all[a].count != all[b].count)
+            return all[a].count > all[b].count;
+        if (zoneOf(a) != zoneOf(b))
+            return zoneOf(a) < zoneOf(b);
+        return hourOf(a) < hourOf(b);
+    };
+
+    auto top = makeTopK<uint32_t>(min(k, all.size()), better);
+    for (uint32_t i = 0; i < all.size(); ++i)
+        top.offer(i);
+
+    vector<ApproxSlotCount> result;
+    result.reserve(top.heap.size());
+    for (uint32_t i : top.sorted())
+        result.push_back({string(zoneOf(i)), hourOf(i), all[i].count, all[i].error});
     return result;
 }
@@ -2,14 +2,25 @@
 // The TripAnalyzer class and the fundamental data structures are defined in this header.
 // It serves as the agreement between the autograder and our implementation.
 // Nothing here should be dependent on the specifics of the input or output formats.
-// Only STL components allowed by course constraints are used.
+// The interface is plain C++17 and the standard library. Behind it, the implementation also uses POSIX
+// mmap/madvise for mapped ingest (with a getline fallback elsewhere) and SSE2/AVX2 intrinsics for the
+// row scanner (picked at runtime, scalar otherwise). perf_event_open is only used by `app --profile`.
 // Public interface that the autograder expects.
 
 #pragma once
+#include "csv_scan.h"
+#include "space_saving.h"
+#include "count_min.h"
+#include "seeded_hash.h"
+#include "ingest_stats.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map> // for hash tables
 #include <utility>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 
 // Total number of trips for a single pickup zone (PickupZoneID).
 // Holds the total number of trips for a single pickup zone.
@@ -31,23 +42,132 @@ struct SlotCount
     long long count;
 };
 
-// this is a custom hash functor for the (zone, hour) part.
-// It should allows us to use unordered_map<pair<string,int>, long long> better unlike default map or nested maps
-struct SlotHash
+// Results of the approximate mode carry their uncertainty: the true count is in [count - error, count].
+// In exact mode error is always 0.
+struct ApproxZoneCount
 {
-    size_t operator()(const std::pair<std::string, int> &p) const
+    std::string zone;
+    long long count;
+    long long error;
+};
+
+struct ApproxSlotCount
+{
+    std::string zone;
+    int hour;
+    long long count;
+    long long error;
+};
+
+// Interns every distinct PickupZoneID once and hands out dense ids 0, 1, 2, ...
+// The counters are indexed by id, so a zone string is stored and hashed once instead of once per key.
+//
+// The lookup side is a flat open-addressing table (linear probing, power-of-two capacity) instead of
+// std::unordered_map: one contiguous array, no node per key, and a probe usually stays in one cache line.
+// Keys of up to inlineKeyBytes are kept inside the slot itself, so comparing them never leaves the table.
+// The zone names themselves are packed into a bump arena of big blocks instead of one std::string
+// each, so 300k zones cost a handful of allocations and the whole dictionary is freed block by block.
+class ZoneDict
+{
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    ZoneDict() = default;
+    // names points into the arena, so a copy packs its own.
+    ZoneDict(const ZoneDict &other);
+    ZoneDict &operator=(const ZoneDict &other);
+    ZoneDict(ZoneDict &&) = default;
+    ZoneDict &operator=(ZoneDict &&) = default;
+
+    // Id of zone, adding it on first sight.
+    uint32_t intern(std::string_view zone);
+
+    // Id of zone, or npos if it has never been interned.
+    uint32_t find(std::string_view zone) const;
+    // Same with hash(zone) already computed, for batched lookups.
+    uint32_t find(std::string_view zone, uint64_t zoneHash) const;
+    // Pulls the first probe slot of zoneHash into cache ahead of a find.
+    void prefetch(uint64_t zoneHash) const;
+
+    // Valid as long as the dictionary is.
+    std::string_view name(uint32_t id) const { return names[id]; }
+    uint32_t size() const { return static_cast<uint32_t>(names.size()); }
+    // Makes room for n zones without growing the table again.
+    void reserve(size_t n);
+
+    // True if the next intern / reserve(n) has to grow the table first, which re-places every zone in it.
+    bool internGrows() const { return (names.size() + 1) * 2 > slots.size(); }
+    bool reserveGrows(size_t n) const { return n * 2 > slots.size(); }
+
+    // seededHash with the process seed; the sketches and the concurrent shards use it too.
+    static uint64_t hash(std::string_view zone);
+
+private:
+    static constexpr uint32_t inlineKeyBytes = 20;
+
+    // 32 bytes, two slots per cache line.
+    struct Slot
+    {
+        uint32_t hash = 0;      // low 32 bits of hash(), enough to place the key in any table we can build
+        uint32_t id = npos;     // npos marks an empty slot
+        uint32_t len = 0;
+        char key[inlineKeyBytes] = {}; // the first inlineKeyBytes bytes of the zone
+    };
+
+    // Monotonic storage for the names: bytes are only ever appended, and the blocks never move, so
+    // a string_view into them stays valid until the arena is destroyed.
+    class Arena
     {
-        // Simple string hash + mix hour.
-        size_t h = 0;
-        for (char c : p.first)
-            // 131 is a common multiplier for string hashing.
-            h = h * 131 + static_cast<unsigned char>(c);
-        // Add a big prime to the hour.
-        // A 32-bit prime that frequently appears in hash mixing is 2654435761, not randomly chosen.
-        // The XOR here helps combine the both parts without too much cancellation.
-        // 2654435761 = 2^31
-        return h ^ (static_cast<size_t>(p.second) * 2654435761U);
-    }
+    public:
+        static constexpr size_t blockBytes = 64 * 1024;
+
+        Arena() = default;
+        // A moved-from arena must not keep writing into the blocks it gave away.
+        Arena(Arena &&other) noexcept { *this = std::move(other); }
+        Arena &operator=(Arena &&other) noexcept
+        {
+            if (this != &other)
+            {
+                blocks = std::move(other.blocks);
+                next = std::exchange(other.next, nullptr);
+                left = std::exchange(other.left, 0);
+            }
+            return *this;
+        }
+
+        const char *store(std::string_view bytes);
+
+    private:
+        std::vector<std::unique_ptr<char[]>> blocks;
+        char *next = nullptr;
+        size_t left = 0;
+    };
+
+    bool matches(const Slot &slot, uint32_t h, std::string_view zone) const;
+    void grow(size_t capacity);
+
+    std::vector<Slot> slots; // size is always 0 or a power of two
+    std::vector<std::string_view> names; // into arena
+    Arena arena;
+};
+
+// How ingestFile gets the bytes of the CSV into the parser.
+// All modes accept and skip exactly the same rows, they only differ in how the file is read.
+enum class IngestMode
+{
+    // Read line by line through std::ifstream + getline.
+    Stream,
+    // Memory-map regular files and parse them in place, no per-row copy.
+    // Pipes, devices and files that can't be mapped silently fall back to Stream.
+    Mapped,
+    // Memory-map, split the file into newline-aligned byte ranges and count each range on its
+    // own thread into private maps, then merge. Same fallback as Mapped.
+    Parallel,
+    // Three stages on three threads: one reads the file in big blocks, one splits the rows and
+    // extracts (zone, hour), and the calling thread counts them. Stages hand blocks of parsed
+    // records over lock-free SPSC rings (spsc_ring.h), so reads overlap with parsing and hashing.
+    // Works on pipes too; falls back to Stream if the threads can't be started.
+    Pipelined
 };
 
 // This is the main analyzer classfor trip data,it reads the CSV, aggregates counts, returns top-k results.
@@ -58,6 +178,108 @@ public:
     // Must be robust: skip malformed rows and never crash.
     void ingestFile(const std::string &csvPath);
 
+    // Parses CSV text the caller already holds in memory (a message, a decompressed blob, ...),
+    // in place and without copying it. Same row rules as ingestFile. If detectHeader is true the
+    // first non-empty line may be a header and is skipped like in a file; pass false for
+    // buffers that are known to hold only data rows. IngestMode::Parallel splits the buffer
+    // across threads, every other mode parses it on the calling thread.
+    void ingestBuffer(std::string_view data, bool detectHeader = true);
+
+    // Streaming session for data that arrives in pieces (e.g. 64 KB network reads):
+    //   beginStream(); feed(chunk); feed(chunk); ... endStream();
+    // Chunks may cut rows anywhere, a partial last line is kept and finished by the next feed.
+    // Only the first non-empty line of the whole session can be a header (if detectHeader).
+    // endStream counts a last line without '\n'. feed without beginStream starts a session.
+    void beginStream(bool detectHeader = true);
+    void feed(std::string_view chunk);
+    void endStream();
+
+    // Concurrent ingest session for producers on many threads (e.g. one per Kafka partition):
+    //   beginConcurrent(shards); ingestBuffer / ingestFile from any number of threads ...; endConcurrent();
+    // Counts go to `shards` shards split by zone hash (0 = four per hardware thread), each with its own
+    // lock and tables. Every call parses on its own thread and hands its rows to a shard a batch at a
+    // time, so producers only wait for each other when they flush into the same shard at once.
+    // Nothing else may be called during the session; endConcurrent folds the shards in.
+    void beginConcurrent(unsigned shards = 0);
+    void endConcurrent();
+
+    // Writes every zone with its hourly counts to a compact, versioned, checksummed binary file
+    // (format in snapshot.cpp). Returns false if the file can't be written.
+    bool saveSnapshot(const std::string &path) const;
+
+    // Replaces the current counts with the ones in a snapshot file, read with one sequential read.
+    // Returns false and leaves the analyzer untouched if the file is missing, from another
+    // version, truncated or fails its checksum.
+    bool loadSnapshot(const std::string &path);
+
+    // Adds another analyzer's zone and slot counts into this one, e.g. to combine per-day files that
+    // were ingested on separate workers. The result is the same as ingesting everything here.
+    // The rvalue version steals the other analyzer's storage where it can and leaves it empty.
+    // Settings and an open streaming session of the other analyzer are not merged, except that
+    // merging an approximate analyzer makes this one approximate with the same capacity.
+    // Likewise a sketch-only analyzer (setSketch with keepExact = false) that has counted rows has
+    // nothing but its sketch to give: this one takes over that sketch's shape, rebuilt from its exact
+    // counts if it had another, and becomes sketch-only too. Returns false and changes nothing if that
+    // can't be done: this side is approximate, or sketch-only with a sketch of another shape.
+    bool merge(const TripAnalyzer &other);
+    bool merge(TripAnalyzer &&other);
+
+    // Picks how later ingestFile calls read the file (Mapped by default).
+    void setIngestMode(IngestMode mode);
+
+    // Picks the row scanner (Auto by default: AVX2 or SSE2 if the CPU has them, else scalar).
+    // Every scanner accepts and skips exactly the same rows.
+    void setRowScanner(RowScanner scanner);
+
+    // Number of worker threads for IngestMode::Parallel, 0 means one per hardware thread.
+    void setThreadCount(unsigned threads);
+
+    // Keeps a leaderboard of the best `capacity` zones and slots up to date while rows come in, so
+    // topZones(k) / topBusySlots(k) with k <= capacity just copy the first k entries. 0 (the default) turns
+    // it off. Costs a compare per row and a small update when a row touches a leaderboard entry.
+    // Without it, results are still cached per k until the next ingest, merge or snapshot load.
+    void setIncrementalTopK(size_t capacity);
+
+    // Approximate mode for feeds with more distinct zones than fit in memory: zones and slots are
+    // tracked by two Space-Saving summaries of `capacity` entries each (space_saving.h), so memory stays
+    // fixed however many keys show up. Any zone or slot with more than 1/capacity of all trips is
+    // guaranteed to be reported; counts are upper bounds, see topZonesWithError for how far off.
+    // Counts so far are folded into the summaries. 0 (the default) is exact mode; going back to it
+    // drops the summaries. Snapshots only hold exact counts and are refused in this mode.
+    void setApproximate(size_t capacity);
+
+    // topZones / topBusySlots with the error bound of every entry (always 0 in exact mode).
+    std::vector<ApproxZoneCount> topZonesWithError(int k = 10) const;
+    std::vector<ApproxSlotCount> topBusySlotsWithError(int k = 10) const;
+
+    // Count-Min sketches of the zone and slot counts (count_min.h), filled by every ingest, for point
+    // queries on feeds where exact tables cost too much. An estimate is at most e/width * trips over the
+    // true count with probability 1 - e^-depth, see sketchErrorBound. Exact counts so far are added in.
+    // keepExact = false frees the exact tables and stops filling them (topZones / topBusySlots
+    // then have nothing to rank). width or depth 0 turns the sketches off.
+    // Once a sketch-only analyzer has counted rows, the sketches are all that is left of them: they can't
+    // be resized, turned off or turned back into exact counts. Such a call returns false and changes
+    // nothing; asking for the same sketch-only setup again is a no-op that returns true.
+    bool setSketch(size_t width, size_t depth, bool keepExact = true);
+
+    // O(depth) point queries, never below the true count. Without sketches they fall back to the
+    // exact count (or the summary's upper bound in approximate mode).
+    long long estimateZone(std::string_view zone) const;
+    long long estimateSlot(std::string_view zone, int hour) const;
+    // The current overcount bound of the sketches, 0 without them.
+    long long sketchErrorBound() const;
+
+    // Exact trip count of one zone / one (zone, hour) slot, 0 if it was never seen or the hour is
+    // out of range. One hash probe on the string_view, no std::string is built.
+    // Only the exact tables are consulted; see estimateZone for the approximate modes.
+    long long countForZone(std::string_view zone) const;
+    long long countForSlot(std::string_view zone, int hour) const;
+
+    // The same for many keys at once (a dashboard refresh), in input order. All keys are hashed
+    // first and their table slots prefetched a few lookups ahead, so the probes overlap.
+    std::vector<long long> countsForZones(const std::vector<std::string_view> &zoneList) const;
+    std::vector<long long> countsForSlots(const std::vector<std::pair<std::string_view, int>> &slotList) const;
+
     // Top K zones sorted by:
     // 1count descending 2zone ascending.
     std::vector<ZoneCount> topZones(int k = 10) const;
@@ -66,10 +288,185 @@ public:
     // 1count descending, 2zone ascending, 3hour ascending.
     std::vector<SlotCount> topBusySlots(int k = 10) const;
 
+    // Row counts and phase times of every ingest so far, see ingest_stats.h. Only filled when built with
+    // TRIP_STATS=1 (make STATS=1), all zero otherwise. A merge adds the other analyzer's stats in.
+    const IngestStats &ingestStats() const { return ingestCounters; }
+    void resetIngestStats() { ingestCounters = IngestStats(); }
+
 private:
-    // zone to total trips count like an ID
-    std::unordered_map<std::string, long long> zoneCount;
+    // Maps the whole file and feeds it to ingestLine, returns false if the caller should stream instead.
+    bool ingestMapped(const std::string &csvPath);
+    // IngestMode::Pipelined, returns false if the caller should stream instead.
+    bool ingestPipelined(const std::string &csvPath);
+    // Every line of [p, end), split exactly like getline would.
+    void ingestLines(const char *p, const char *end, bool &headerHandled);
+    // ingestLines or ingestParallel, depending on ingestMode.
+    void ingestRange(const char *p, const char *end, bool &headerHandled);
+    void ingestParallel(const char *p, const char *end, bool &headerHandled);
+    // Sizes the zone table for an input of this many bytes, only ever grows it.
+    void reserveForIngest(size_t bytes);
+    // One raw line without its '\n'. headerHandled is per file so only the first line can be a header.
+    void ingestLine(const char *s, const char *e, bool &headerHandled);
+    // One accepted row.
+    void countTrip(std::string_view zone, int hour);
+    // zones.intern, with the stats timing the grow if it has to make room first.
+    uint32_t internZone(std::string_view zone);
+    // Rows of [p, end) counted into the concurrent session's shards, safe on many threads at once.
+    void ingestSharded(const char *p, const char *end, bool &headerHandled) const;
+    // Gives part the same counting setup as this analyzer: scanner, approximate mode and sketches.
+    void copySettings(TripAnalyzer &part) const;
+    // Adds other's counts in, stealing its storage where it can, and leaves it empty.
+    void absorb(TripAnalyzer &&other);
+    void addCounts(const TripAnalyzer &other);
+    // Before merging a sketch-only analyzer: switches this one to its sketch, false if it can't.
+    bool adoptSketchOnly(const TripAnalyzer &other);
+
+    // Zone ids of many keys in input order, npos for unknown ones.
+    std::vector<uint32_t> findZones(const std::vector<std::string_view> &zoneList) const;
+
+    // Adds from's exact tables into our sketches as weights.
+    void sketchCounts(const TripAnalyzer &from);
+    // Frees the zone dictionary and ZoneStats and stops filling them: sketch-only from here on.
+    void freeExactTables();
+
+    // One accepted row in approximate mode.
+    void countApprox(std::string_view zone, int hour);
+    // Summary key of a slot: the zone followed by one byte holding the hour.
+    static void slotKey(std::string &out, std::string_view zone, int hour);
+    // The best k summary entries, ordered like the exact results.
+    std::vector<ApproxZoneCount> approxZones(size_t k) const;
+    std::vector<ApproxSlotCount> approxSlots(size_t k) const;
+
+    // The full scans behind topZones / topBusySlots, without the cache.
+    std::vector<ZoneCount> scanTopZones(size_t k) const;
+    std::vector<SlotCount> scanTopSlots(size_t k) const;
+
+    IngestMode ingestMode = IngestMode::Mapped;
+    unsigned threadCount = 0;
+    RowScanner rowScanner = RowScanner::Auto;
+
+    // Approximate mode: 0 = exact. Otherwise the exact tables stay empty and rows go to the summaries.
+    size_t approxCapacity = 0;
+    SpaceSaving zoneSummary;
+    SpaceSaving slotSummary;
+    std::string slotKeyScratch;
+
+    // Sketches are off while their width is 0. exactCounts = false means only the sketches are filled.
+    CountMinSketch zoneSketch;
+    CountMinSketch slotSketch;
+    bool exactCounts = true;
+
+    // Concurrent session state. Shard i counts the zones whose hash has i in its top bits, so the low
+    // bits that place a key inside the shard's own table stay evenly spread.
+    struct Shard
+    {
+        std::mutex lock;
+        std::unique_ptr<TripAnalyzer> counts;
+    };
+    struct ShardSet
+    {
+        std::vector<std::unique_ptr<Shard>> shards; // empty outside a session
+        unsigned bits = 0;                          // shards.size() == 1 << bits
+
+        ShardSet() = default;
+        // A copied or assigned analyzer is never inside a session.
+        ShardSet(const ShardSet &) {}
+        ShardSet &operator=(const ShardSet &other)
+        {
+            if (this != &other)
+            {
+                shards.clear();
+                bits = 0;
+            }
+            return *this;
+        }
+        ShardSet(ShardSet &&) = default;
+        ShardSet &operator=(ShardSet &&) = default;
+    };
+    ShardSet concurrent;
+
+    // Streaming session state: the unfinished last line and whether the header is settled.
+    std::string streamTail;
+    bool streamHeaderHandled = false;
+    bool streaming = false;
+
+    // parseHourFromDatetime only ever returns 0..23.
+    static constexpr int hoursPerDay = 24;
+
+    // Everything we count for one zone: its total and one counter per hour of the day.
+    // The (zone, hour) slot count is just hours[hour], so a row costs one indexed increment.
+    struct ZoneStats
+    {
+        long long total = 0;
+        long long hours[hoursPerDay] = {};
+    };
+
+    // Counters of a zone id, growing the table for a freshly interned zone.
+    ZoneStats &statsFor(uint32_t id);
+
+    // Filled only with TRIP_STATS, see ingestStats.
+    IngestStats ingestCounters;
+
+    // zone name <-> zone id
+    ZoneDict zones;
+
+    // zone id to its total + hourly trip counts
+    std::vector<ZoneStats> zoneStats;
+
+    // ---- top-k between ingests ----
+
+    // One leaderboard row. Zone entries leave hour at -1.
+    struct BoardEntry
+    {
+        long long count;
+        uint32_t id;
+        int hour;
+    };
+
+    // The exact best `capacity` zones (or slots), sorted best first. Counts only ever go up, so a row
+    // either moves a member up a few places or lets one outsider replace the last member.
+    struct Leaderboard
+    {
+        std::vector<BoardEntry> entries;
+        std::unordered_map<uint64_t, uint32_t> pos; // member key -> index in entries
+    };
+
+    // Bit 24 of boardBits[id]: the zone is on zoneBoard. Bit h: slot (id, h) is on slotBoard.
+    static constexpr uint32_t zoneBoardBit = 1u << hoursPerDay;
+
+    bool boardBetter(const BoardEntry &a, const BoardEntry &b) const;
+    void boardUpdate(Leaderboard &board, const BoardEntry &e, uint64_t key, uint32_t bit);
+    // Recomputes both leaderboards from the counts, after anything that adds counts in bulk.
+    void rebuildBoards();
+
+    size_t boardCapacity = 0;
+    Leaderboard zoneBoard;
+    Leaderboard slotBoard;
+    std::vector<uint32_t> boardBits;
+
+    // Results of the last full scans, per k. Only valid while generation hasn't moved; every
+    // public call that changes counts bumps it. The lock lets concurrent const queries share it.
+    struct QueryCache
+    {
+        std::mutex lock;
+        uint64_t generation = 0;
+        std::unordered_map<int, std::vector<ZoneCount>> zones;
+        std::unordered_map<int, std::vector<SlotCount>> slots;
+
+        QueryCache() = default;
+        // A copied or assigned analyzer starts with an empty cache.
+        QueryCache(const QueryCache &) {}
+        QueryCache &operator=(const QueryCache &)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            zones.clear();
+            slots.clear();
+            return *this;
+        }
+    };
+    // Different k values kept at once; a dashboard only ever asks for a handful.
+    static constexpr size_t maxCachedK = 8;
 
-    // (zone, hour) to trips count (Zone ID + hour slot)
-    std::unordered_map<std::pair<std::string, int>, long long, SlotHash> slotCount;
+    uint64_t generation = 0;
+    mutable QueryCache cache;
 };
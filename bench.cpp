@@ -0,0 +1,625 @@
+// Small self-contained benchmarks for the hot parts of TripAnalyzer.
+// Build and run with `make bench`. Nothing here is part of the graded code.
+
+#include "analyzer.h"
+#include "row_parse.h"
+// Every operator new in this binary is counted, so a section can report how many allocations it made.
+#include "alloc_counter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define BENCH_HAVE_FORK 1
+#endif
+
+// Wall times of the timed runs of one benchmark in nanoseconds, sorted ascending.
+struct Timing
+{
+    vector<double> runs;
+
+    double median() const { return runs[runs.size() / 2]; }
+    // Nearest-rank 99th percentile; with fewer than 100 runs that is the slowest one.
+    double p99() const { return runs[(runs.size() * 99 + 99) / 100 - 1]; }
+};
+
+// Runs fn() warmup times untimed (caches, page faults, branch predictors), then reps timed times.
+template <class Fn>
+static Timing timeRuns(int reps, Fn fn, int warmup = 2)
+{
+    for (int r = 0; r < warmup; ++r)
+        fn();
+    Timing t;
+    for (int r = 0; r < reps; ++r)
+    {
+        auto t0 = chrono::steady_clock::now();
+        fn();
+        auto t1 = chrono::steady_clock::now();
+        t.runs.push_back(chrono::duration<double, nano>(t1 - t0).count());
+    }
+    sort(t.runs.begin(), t.runs.end());
+    return t;
+}
+
+// a - b run by run in rank order: every percentile of the result is that percentile of a minus the
+// same one of b. For a phase that can only be timed together with another one.
+static Timing minusRuns(const Timing &a, const Timing &b)
+{
+    Timing t;
+    for (size_t i = 0; i < a.runs.size() && i < b.runs.size(); ++i)
+        t.runs.push_back(max(a.runs[i] - b.runs[i], 0.0));
+    sort(t.runs.begin(), t.runs.end());
+    return t;
+}
+
+// Machine-readable results: with --json FILE every timed benchmark also appends one JSON object per
+// line to FILE ("-" for stdout), so runs of different releases can be diffed by a script.
+static FILE *jsonOut = nullptr;
+
+// items is what one run processes (rows, fields, zones), so ns_per_item is comparable across sizes.
+static void record(const char *section, const string &name, double items, const Timing &t)
+{
+    if (!jsonOut)
+        return;
+    fprintf(jsonOut,
+            "{\"section\":\"%s\",\"name\":\"%s\",\"items\":%.0f,\"runs\":%zu,\"median_ns\":%.1f,\"p99_ns\":%.1f,"
+            "\"ns_per_item\":%.3f,\"items_per_s\":%.0f}\n",
+            section, name.c_str(), items, t.runs.size(), t.median(), t.p99(), t.median() / items,
+            items / t.median() * 1e9);
+}
+
+// The human-readable line every section prints for one timing.
+static void printTiming(const string &name, double items, const Timing &t)
+{
+    printf("%-22s %8.2f ns/row  p99 %8.2f ns/row  %7.1f M rows/s\n", name.c_str(), t.median() / items,
+           t.p99() / items, items / t.median() * 1e3);
+}
+
+// Zone column of the C1 test: three hot zones, 60k / 30k / 10k rows.
+static vector<string> c1Keys()
+{
+    vector<string> keys;
+    keys.insert(keys.end(), 60000, "ZONE_BIG");
+    keys.insert(keys.end(), 30000, "ZONE_MED");
+    keys.insert(keys.end(), 10000, "ZONE_SMALL");
+    return keys;
+}
+
+// Zone column of the C2 test: 50k zones seen once, then 20k rows of one hot zone.
+static vector<string> c2Keys()
+{
+    vector<string> keys;
+    for (int i = 0; i < 50000; ++i)
+        keys.push_back("ZONE_" + to_string(i));
+    keys.insert(keys.end(), 20000, "ZONE_TOP");
+    return keys;
+}
+
+// The counting loop as the analyzer used to do it: a string copy per row and a node-based map.
+// Neither side reserves, so growth is part of what gets measured.
+static long long countUnorderedMap(const vector<string> &keys)
+{
+    unordered_map<string, long long> counts;
+    for (const auto &k : keys)
+    {
+        string zone(k.data(), k.size());
+        counts[zone] += 1;
+    }
+    return static_cast<long long>(counts.size());
+}
+
+// The counting loop as the analyzer does it now: intern into the flat table, bump a dense counter.
+static long long countZoneDict(const vector<string> &keys)
+{
+    ZoneDict dict;
+    vector<long long> counts;
+    for (const auto &k : keys)
+    {
+        uint32_t id = dict.intern(string_view(k));
+        if (id == counts.size())
+            counts.push_back(0);
+        counts[id] += 1;
+    }
+    return static_cast<long long>(counts.size());
+}
+
+static void benchZoneTable(const char *name, const vector<string> &keys)
+{
+    const int reps = 21;
+    volatile long long sink = 0;
+    Timing map = timeRuns(reps, [&]() { sink = sink + countUnorderedMap(keys); });
+    Timing dict = timeRuns(reps, [&]() { sink = sink + countZoneDict(keys); });
+    double rows = static_cast<double>(keys.size());
+    record("zone_table", string(name) + "/unordered_map", rows, map);
+    record("zone_table", string(name) + "/ZoneDict", rows, dict);
+    double mapNs = map.median(), dictNs = dict.median();
+    printf("%-4s %8zu rows  unordered_map %7.2f ns/row  ZoneDict %7.2f ns/row  speedup %.2fx\n",
+           name, keys.size(), mapNs / rows, dictNs / rows, mapNs / dictNs);
+}
+
+// Writes rows trip rows over a few hundred zones, so the run is dominated by parsing, not by the table.
+static void writeParseFile(const string &path, int rows)
+{
+    ofstream out(path);
+    out << "TripID,PickupZoneID,DropoffZoneID,PickupDateTime,DistanceKm,FareAmount\n";
+    char buf[128];
+    for (int i = 0; i < rows; ++i)
+    {
+        snprintf(buf, sizeof(buf), "%d,ZONE_%03d,ZONE_%03d,2024-01-01 %02d:%02d,%d.%d,%d.50\n",
+                 1000000 + i, i % 512, (i * 7) % 512, i % 24, i % 60, i % 40, i % 10, 5 + i % 90);
+        out << buf;
+    }
+}
+
+static void benchRowScanner(const string &path, int rows, const char *name, RowScanner scanner)
+{
+    Timing t = timeRuns(7, [&]()
+                        {
+                            TripAnalyzer ta;
+                            ta.setRowScanner(scanner);
+                            ta.ingestFile(path);
+                        });
+    record("row_scanner", name, rows, t);
+    printTiming(name, rows, t);
+}
+
+static void benchIngestMode(const string &path, int rows, const char *name, IngestMode mode)
+{
+    Timing t = timeRuns(7, [&]()
+                        {
+                            TripAnalyzer ta;
+                            ta.setIngestMode(mode);
+                            ta.ingestFile(path);
+                        });
+    record("ingest_mode", name, rows, t);
+    printTiming(name, rows, t);
+}
+
+// Times an hour parser over fields laid out back to back, like the datetime column of a real file.
+template <class Parse>
+static double hourParseNs(const char *name, const string &fields, size_t count, size_t stride, Parse parse)
+{
+    volatile int sink = 0;
+    Timing t = timeRuns(21, [&]()
+                        {
+                            int sum = 0;
+                            const char *p = fields.data();
+                            for (size_t i = 0; i < count; ++i, p += stride)
+                                sum += parse(p, p + 16);
+                            sink = sink + sum;
+                        });
+    record("hour_parse", name, static_cast<double>(count), t);
+    return t.median() / count;
+}
+
+static void benchHourParse()
+{
+    // "YYYY-MM-DD HH:MM," fields, 17 bytes apart.
+    const size_t count = 1000000;
+    const size_t stride = 17;
+    string fields;
+    fields.reserve(count * stride);
+    char buf[32];
+    for (size_t i = 0; i < count; ++i)
+    {
+        snprintf(buf, sizeof(buf), "2024-%02zu-%02zu %02zu:%02zu,", 1 + i % 12, 1 + i % 28, i % 24, i % 60);
+        fields += buf;
+    }
+
+    double general = hourParseNs("general", fields, count, stride, parseHourGeneral);
+    double fast = hourParseNs("fixed", fields, count, stride, parseHourFromDatetime);
+    printf("general  %6.2f ns/row\n", general);
+    printf("fixed    %6.2f ns/row  speedup %.2fx\n", fast, general / fast);
+}
+
+// The C2 rows as one CSV buffer; prefix makes the zone names longer than the small-string buffer.
+static string c2Buffer(const string &prefix)
+{
+    string data;
+    int row = 0;
+    for (const auto &k : c2Keys())
+        data += to_string(++row) + "," + prefix + k + ",ZX,2024-01-01 08:00,1,1\n";
+    return data;
+}
+
+// Ingests data into a fresh analyzer in a child process, so the growth of its peak RSS is the
+// analyzer's alone, and reports allocations, ingest and destruction time.
+static void benchMemory(const char *name, const string &data)
+{
+#ifdef BENCH_HAVE_FORK
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        long rssBefore = ru.ru_maxrss;
+        size_t before = allocationCount();
+        auto *ta = new TripAnalyzer;
+        auto t0 = chrono::steady_clock::now();
+        ta->ingestBuffer(data, false);
+        auto t1 = chrono::steady_clock::now();
+        size_t allocs = allocationCount() - before;
+        delete ta;
+        auto t2 = chrono::steady_clock::now();
+        getrusage(RUSAGE_SELF, &ru);
+        printf("%-8s allocations %7zu  ingest %6.2f ms  destroy %5.2f ms  peak RSS +%ld KB\n", name, allocs,
+               chrono::duration<double, milli>(t1 - t0).count(), chrono::duration<double, milli>(t2 - t1).count(),
+               static_cast<long>(ru.ru_maxrss - rssBefore));
+        fflush(stdout);
+        _exit(0);
+    }
+    if (pid > 0)
+        waitpid(pid, nullptr, 0);
+#else
+    (void)name;
+    (void)data;
+#endif
+}
+
+// Producers on `threads` threads push 1.4M C2-shaped rows (50k zones, one zone with ~28% of the rows)
+// into one analyzer through a concurrent session, each in ~64 KB messages like a queue consumer would.
+static Timing concurrentRuns(const vector<string> &messages, unsigned threads)
+{
+    return timeRuns(5, [&]()
+                    {
+                        TripAnalyzer ta;
+                        ta.beginConcurrent();
+                        vector<thread> producers;
+                        for (unsigned t = 0; t < threads; ++t)
+                            producers.emplace_back([&, t]()
+                                                   {
+                                                       for (size_t m = t; m < messages.size(); m += threads)
+                                                           ta.ingestBuffer(messages[m], false);
+                                                   });
+                        for (auto &p : producers)
+                            p.join();
+                        ta.endConcurrent();
+                    });
+}
+
+static void benchConcurrent()
+{
+    vector<string> messages(1);
+    size_t rows = 0;
+    const vector<string> keys = c2Keys();
+    for (int pass = 0; pass < 20; ++pass)
+    {
+        for (size_t i = 0; i < keys.size(); ++i, ++rows)
+        {
+            // Interleave the hot zone with the rest instead of leaving it as one block at the end.
+            const string &k = keys[(i * 7919) % keys.size()];
+            messages.back() += to_string(rows) + "," + k + ",ZX,2024-01-01 " + (i % 24 < 10 ? "0" : "") +
+                               to_string(i % 24) + ":00,1,1\n";
+            if (messages.back().size() >= 64 * 1024)
+                messages.emplace_back();
+        }
+    }
+
+    // The same messages into a plain analyzer on one thread, without a session.
+    Timing plain = timeRuns(5, [&]()
+                            {
+                                TripAnalyzer ta;
+                                for (const auto &m : messages)
+                                    ta.ingestBuffer(m, false);
+                            });
+    record("concurrent", "no_session", rows, plain);
+    printTiming("no session", rows, plain);
+
+    double base = 0;
+    for (unsigned threads : {1u, 2u, 4u, 8u, 16u})
+    {
+        Timing t = concurrentRuns(messages, threads);
+        string name = to_string(threads) + " threads";
+        record("concurrent", to_string(threads) + "_threads", rows, t);
+        if (threads == 1)
+            base = t.median();
+        printf("%-22s %8.2f ns/row  p99 %8.2f ns/row  %7.1f M rows/s  speedup %.2fx\n", name.c_str(),
+               t.median() / rows, t.p99() / rows, rows / t.median() * 1e3, base / t.median());
+    }
+}
+
+// The phases of an ingest and of the queries after it, each timed on its own over the same 1M rows
+// (50k zones, C2-like): splitting a row, reading the hour, updating the counters, ranking the result.
+static void benchPhases()
+{
+    const size_t rows = 1000000;
+    const size_t zoneCount = 50000;
+    string data;
+    data.reserve(rows * 48);
+    char buf[128];
+    for (size_t i = 0; i < rows; ++i)
+    {
+        snprintf(buf, sizeof(buf), "%zu,ZONE_%zu,ZONE_X,2024-01-01 %02zu:%02zu,3.5,12.50\n", 1000000 + i,
+                 (i * 7919) % zoneCount, i % 24, i % 60);
+        data += buf;
+    }
+
+    // Datetime fields located once, so the hour phase only times its own work.
+    vector<pair<const char *, const char *>> datetimes;
+    datetimes.reserve(rows);
+    for (const char *p = data.data(), *end = p + data.size(); p < end;)
+    {
+        const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+        const char *f = p;
+        for (int c = 0; c < 3; ++c)
+            f = static_cast<const char *>(memchr(f, ',', nl - f)) + 1;
+        datetimes.push_back({f, static_cast<const char *>(memchr(f, ',', nl - f))});
+        p = nl + 1;
+    }
+
+    // Splitting the buffer and parseRow6, exactly what ingestBuffer does per row with the scalar scanner.
+    volatile long long sink = 0;
+    Timing parse = timeRuns(11, [&]()
+                            {
+                                long long sum = 0;
+                                string_view zone;
+                                int hour = -1;
+                                for (const char *p = data.data(), *end = p + data.size(); p < end;)
+                                {
+                                    const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+                                    const char *e = nl ? nl : end;
+                                    stripTrailingCR(p, e);
+                                    if (parseRow6(p, e, zone, hour))
+                                        sum += hour + static_cast<long long>(zone.size());
+                                    p = nl ? nl + 1 : end;
+                                }
+                                sink = sink + sum;
+                            });
+    Timing hour = timeRuns(11, [&]()
+                           {
+                               long long sum = 0;
+                               for (const auto &d : datetimes)
+                                   sum += parseHourFromDatetime(d.first, d.second);
+                               sink = sink + sum;
+                           });
+
+    // The counter update is TripAnalyzer's own row path (countTrip, ZoneStats and whatever hooks it has),
+    // timed as a whole scalar ingestBuffer of the same buffer with the parse phase taken off again.
+    Timing freshIngest = timeRuns(11, [&]()
+                                  {
+                                      TripAnalyzer fresh;
+                                      fresh.setRowScanner(RowScanner::Scalar);
+                                      fresh.ingestBuffer(data, false);
+                                      sink = sink + fresh.countForZone("ZONE_0");
+                                  });
+    // Every zone already known: the steady state of a long-running ingest.
+    TripAnalyzer known;
+    known.setRowScanner(RowScanner::Scalar);
+    Timing warmIngest = timeRuns(11, [&]() { known.ingestBuffer(data, false); });
+    Timing fresh = minusRuns(freshIngest, parse);
+    Timing warm = minusRuns(warmIngest, parse);
+
+    // An empty ingest bumps the generation, so every run really rescans instead of hitting the cache.
+    TripAnalyzer ta;
+    ta.ingestBuffer(data, false);
+    Timing topZ = timeRuns(21, [&]()
+                           {
+                               ta.ingestBuffer(string_view(), false);
+                               sink = sink + ta.topZones(10)[0].count;
+                           });
+    Timing topS = timeRuns(21, [&]()
+                           {
+                               ta.ingestBuffer(string_view(), false);
+                               sink = sink + ta.topBusySlots(10)[0].count;
+                           });
+
+    const double n = static_cast<double>(rows);
+    record("phases", "split_parseRow6", n, parse);
+    record("phases", "parseHourFromDatetime", n, hour);
+    record("phases", "counter_update_fresh", n, fresh);
+    record("phases", "counter_update_warm", n, warm);
+    record("phases", "topZones_10", zoneCount, topZ);
+    record("phases", "topBusySlots_10", zoneCount * 24.0, topS);
+    printTiming("split + parseRow6", n, parse);
+    printTiming("parseHourFromDatetime", n, hour);
+    printTiming("update (fresh table)", n, fresh);
+    printTiming("update (warm table)", n, warm);
+    printf("%-22s %8.1f us/query  p99 %8.1f us/query  (%zu zones)\n", "topZones(10)", topZ.median() / 1e3,
+           topZ.p99() / 1e3, zoneCount);
+    printf("%-22s %8.1f us/query  p99 %8.1f us/query  (%zu slots)\n", "topBusySlots(10)", topS.median() / 1e3,
+           topS.p99() / 1e3, zoneCount * 24);
+}
+
+// The zone hash before it was seeded: a fixed multiply-xorshift over 8-byte words and a murmur
+// finalizer. Kept here only to compare speed with seededHash.
+static uint64_t unseededHash(string_view zone)
+{
+    const char *p = zone.data();
+    size_t n = zone.size();
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ n;
+    for (; n >= 8; p += 8, n -= 8)
+    {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 29;
+    }
+    if (n > 0)
+    {
+        uint64_t w = 0;
+        memcpy(&w, p, n);
+        h = (h ^ w) * 0xBF58476D1CE4E5B9ull;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// count zone names whose hash under seed agrees in the low bits, like gen_trips --dist collide.
+static vector<string> collidingKeys(size_t count, uint64_t seed, unsigned bits)
+{
+    vector<string> keys;
+    const uint64_t mask = (uint64_t(1) << bits) - 1;
+    uint64_t target = seededHash("ZONE_0", seed) & mask;
+    for (uint64_t i = 0; keys.size() < count; ++i)
+    {
+        string name = "ZONE_" + to_string(i);
+        if ((seededHash(name, seed) & mask) == target)
+            keys.push_back(std::move(name));
+    }
+    return keys;
+}
+
+static void benchHashing()
+{
+    volatile uint64_t sink = 0;
+    const vector<string> keys = c2Keys();
+    const double n = static_cast<double>(keys.size());
+    Timing oldHash = timeRuns(21, [&]()
+                              {
+                                  uint64_t x = 0;
+                                  for (const auto &k : keys)
+                                      x += unseededHash(k);
+                                  sink = sink + x;
+                              });
+    Timing newHash = timeRuns(21, [&]()
+                              {
+                                  uint64_t x = 0;
+                                  for (const auto &k : keys)
+                                      x += seededHash(k, hashSeed());
+                                  sink = sink + x;
+                              });
+    record("hash", "unseeded", n, oldHash);
+    record("hash", "seededHash", n, newHash);
+    printTiming("unseeded hash (C2)", n, oldHash);
+    printTiming("seededHash (C2)", n, newHash);
+
+    // 4000 zones built to share one probe chain under seed 0, interned into a fresh ZoneDict: once with
+    // the producer knowing the seed (what an unseeded hash always allows), once with the random one.
+    const size_t count = 4000;
+    const uint64_t attackedSeed = 0;
+    vector<string> crafted = collidingKeys(count, attackedSeed, 16);
+    vector<string> plain;
+    for (size_t i = 0; i < count; ++i)
+        plain.push_back("ZONE_" + to_string(i));
+    auto intern = [&sink](const vector<string> &names)
+    {
+        return timeRuns(5, [&]()
+                        {
+                            ZoneDict dict;
+                            for (const auto &name : names)
+                                dict.intern(name);
+                            sink = sink + dict.size();
+                        });
+    };
+
+    const uint64_t ownSeed = hashSeed();
+    Timing normal = intern(plain);
+    Timing resisted = intern(crafted);
+    setHashSeed(attackedSeed);
+    Timing flooded = intern(crafted);
+    setHashSeed(ownSeed);
+    record("hash", "intern_plain", count, normal);
+    record("hash", "intern_crafted_random_seed", count, resisted);
+    record("hash", "intern_crafted_known_seed", count, flooded);
+    printTiming("intern plain", count, normal);
+    printTiming("intern crafted", count, resisted);
+    printTiming("  ... seed known", count, flooded);
+}
+
+// bench_runner [--json FILE] [SECTION...]
+// Sections: phases, zone, scanner, ingest, concurrent, memory, hour, hash. Without any, all of them run.
+int main(int argc, char **argv)
+{
+    vector<string> only;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc)
+        {
+            string file = argv[++i];
+            jsonOut = file == "-" ? stdout : fopen(file.c_str(), "w");
+            if (!jsonOut)
+            {
+                fprintf(stderr, "cannot write %s\n", file.c_str());
+                return 1;
+            }
+        }
+        else
+        {
+            only.push_back(arg);
+        }
+    }
+    auto wanted = [&only](const char *section)
+    { return only.empty() || find(only.begin(), only.end(), section) != only.end(); };
+
+    printf("Every timing: 2 warm-up runs, then the median and p99 of the timed runs.\n");
+    if (wanted("phases"))
+    {
+        printf("\nPHASES (1M rows, 50k zones; parse and update median of 11 runs, queries of 21)\n");
+        benchPhases();
+    }
+
+    if (wanted("zone"))
+    {
+        printf("\nZONE TABLE (median of 21 runs, fresh table each run)\n");
+        benchZoneTable("C1", c1Keys());
+        benchZoneTable("C2", c2Keys());
+    }
+
+    const string path = "bench_rows.csv";
+    const int rows = 1000000;
+    if (wanted("scanner") || wanted("ingest"))
+        writeParseFile(path, rows);
+    if (wanted("scanner"))
+    {
+        printf("\nROW SCANNER (mapped ingest of %d rows, median of 7 runs)\n", rows);
+        benchRowScanner(path, rows, "scalar", RowScanner::Scalar);
+        benchRowScanner(path, rows, "sse2", RowScanner::SSE2);
+        benchRowScanner(path, rows, "avx2", RowScanner::AVX2);
+    }
+    if (wanted("ingest"))
+    {
+        printf("\nINGEST MODE (%d rows, median of 7 runs)\n", rows);
+        benchIngestMode(path, rows, "stream", IngestMode::Stream);
+        benchIngestMode(path, rows, "mapped", IngestMode::Mapped);
+        benchIngestMode(path, rows, "pipelined", IngestMode::Pipelined);
+    }
+    remove(path.c_str());
+
+    if (wanted("concurrent"))
+    {
+        printf("\nCONCURRENT INGEST (C2 rows in 64 KB messages, sharded session, median of 5 runs, %u hardware threads)\n",
+               thread::hardware_concurrency());
+        benchConcurrent();
+    }
+
+    if (wanted("memory"))
+    {
+        printf("\nMEMORY (C2 rows through ingestBuffer, one run in a child process)\n");
+        benchMemory("C2", c2Buffer(""));
+        benchMemory("C2 long", c2Buffer("PICKUP_AREA_WITH_A_LONG_NAME_"));
+    }
+
+    if (wanted("hour"))
+    {
+        printf("\nHOUR PARSE (1M \"YYYY-MM-DD HH:MM\" fields, median of 21 runs)\n");
+        benchHourParse();
+    }
+
+    if (wanted("hash"))
+    {
+        printf("\nHASH (70k C2 keys, median of 21 runs; 4000 zones into a fresh ZoneDict, median of 5)\n");
+        benchHashing();
+    }
+
+    if (jsonOut && jsonOut != stdout)
+        fclose(jsonOut);
+    return 0;
+}
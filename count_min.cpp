@@ -0,0 +1,77 @@
+// Count-Min sketch, see count_min.h.
+
+#include "count_min.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+using namespace std;
+
+CountMinSketch::CountMinSketch(size_t width, size_t depth)
+    : w(width && depth ? width : 0), d(width && depth ? depth : 0), cells(w * d, 0)
+{
+}
+
+// Double hashing: row r uses h1 + r * h2, both halves of the one 64-bit hash.
+inline size_t CountMinSketch::cell(uint64_t keyHash, size_t row) const
+{
+    uint64_t h1 = keyHash & 0xFFFFFFFFull;
+    uint64_t h2 = (keyHash >> 32) | 1;
+    return row * w + static_cast<size_t>((h1 + row * h2) % w);
+}
+
+void CountMinSketch::add(uint64_t keyHash, long long weight)
+{
+    if (!w || weight <= 0)
+        return;
+    n += weight;
+
+    // Conservative update: the new estimate is the old one plus weight, and no counter needs to be
+    // higher than that to keep every estimate an upper bound.
+    long long target = estimate(keyHash) + weight;
+    for (size_t r = 0; r < d; ++r)
+    {
+        long long &c = cells[cell(keyHash, r)];
+        c = max(c, target);
+    }
+}
+
+long long CountMinSketch::estimate(uint64_t keyHash) const
+{
+    if (!w)
+        return 0;
+    long long best = LLONG_MAX;
+    for (size_t r = 0; r < d; ++r)
+        best = min(best, cells[cell(keyHash, r)]);
+    return best;
+}
+
+void CountMinSketch::addSketch(const CountMinSketch &other)
+{
+    if (!sameShape(other))
+        return;
+    for (size_t i = 0; i < cells.size(); ++i)
+        cells[i] += other.cells[i];
+    n += other.n;
+}
+
+long long CountMinSketch::errorBound() const
+{
+    if (!w)
+        return 0;
+    return static_cast<long long>(ceil(exp(1.0) / static_cast<double>(w) * static_cast<double>(n)));
+}
+
+void CountMinSketch::clear()
+{
+    fill(cells.begin(), cells.end(), 0);
+    n = 0;
+}
+
+uint64_t CountMinSketch::combine(uint64_t keyHash, uint64_t value)
+{
+    uint64_t h = keyHash ^ ((value + 1) * 0x9E3779B97F4A7C15ull);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    return h;
+}
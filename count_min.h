@@ -0,0 +1,46 @@
+// Count-Min sketch with conservative update (Cormode & Muthukrishnan; Estan & Varghese).
+// depth rows of width counters; a key bumps one counter per row and its estimate is the smallest of
+// them. Estimates never undercount. With N total weight, an estimate is over the true count by at
+// most e/width * N with probability at least 1 - e^-depth (errorBound() gives that number).
+// Conservative update only raises the counters that have to rise, which keeps the overcount well
+// below the bound in practice.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class CountMinSketch
+{
+public:
+    CountMinSketch() = default;
+    CountMinSketch(size_t width, size_t depth);
+
+    // Keys come in pre-hashed (64 bits, well mixed), the row positions are derived from that hash.
+    void add(uint64_t keyHash, long long weight = 1);
+    long long estimate(uint64_t keyHash) const;
+
+    // Cell-wise sum with a sketch of the same shape. The result still never undercounts.
+    void addSketch(const CountMinSketch &other);
+    bool sameShape(const CountMinSketch &other) const { return w == other.w && d == other.d; }
+
+    // e/width * total, rounded up: the overcount bound that holds with probability 1 - e^-depth.
+    long long errorBound() const;
+
+    size_t width() const { return w; }
+    size_t depth() const { return d; }
+    long long total() const { return n; }
+    bool enabled() const { return w != 0; }
+    void clear();
+
+    // Hash of a (key, small value) pair from the key's hash, so a slot doesn't rehash its zone.
+    static uint64_t combine(uint64_t keyHash, uint64_t value);
+
+private:
+    size_t cell(uint64_t keyHash, size_t row) const;
+
+    size_t w = 0;
+    size_t d = 0;
+    long long n = 0;
+    std::vector<long long> cells; // row r is cells[r * w, (r + 1) * w)
+};
@@ -0,0 +1,119 @@
+// SSE2 / AVX2 line scanners, picked at runtime.
+
+#include "csv_scan.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define TRIP_HAVE_X86_SIMD 1
+#endif
+
+// Byte-at-a-time tail for the last few bytes that don't fill a vector.
+static inline void scanTail(const char *p, const char *bufEnd, LineScan &out)
+{
+    for (; p < bufEnd; ++p)
+    {
+        if (*p == '\n')
+            break;
+        if (*p == ',' && out.commas < LineScan::maxCommas)
+            out.comma[out.commas++] = p;
+    }
+    out.end = p;
+}
+
+#ifdef TRIP_HAVE_X86_SIMD
+
+// Records the commas of one block. mask has bit i set if block[i] is a comma, already cut
+// at the newline if the block holds one.
+static inline void takeCommas(const char *block, unsigned mask, LineScan &out)
+{
+    while (mask && out.commas < LineScan::maxCommas)
+    {
+        out.comma[out.commas++] = block + __builtin_ctz(mask);
+        mask &= mask - 1;
+    }
+}
+
+static void scanLineSSE2(const char *p, const char *bufEnd, LineScan &out)
+{
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    out.commas = 0;
+
+    while (bufEnd - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned cm = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, comma)));
+        unsigned nm = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)));
+        if (nm)
+        {
+            // Only commas in front of the first newline belong to this line.
+            takeCommas(p, cm & ((nm & -nm) - 1), out);
+            out.end = p + __builtin_ctz(nm);
+            return;
+        }
+        takeCommas(p, cm, out);
+        p += 16;
+    }
+    scanTail(p, bufEnd, out);
+}
+
+__attribute__((target("avx2"))) static void scanLineAVX2(const char *p, const char *bufEnd, LineScan &out)
+{
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    out.commas = 0;
+
+    while (bufEnd - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        unsigned cm = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, comma)));
+        unsigned nm = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)));
+        if (nm)
+        {
+            takeCommas(p, cm & ((nm & -nm) - 1), out);
+            out.end = p + __builtin_ctz(nm);
+            return;
+        }
+        takeCommas(p, cm, out);
+        p += 32;
+    }
+    // Finish with one 16-byte step if it fits, then bytes.
+    if (bufEnd - p >= 16)
+    {
+        LineScan rest;
+        scanLineSSE2(p, bufEnd, rest);
+        for (int i = 0; i < rest.commas && out.commas < LineScan::maxCommas; ++i)
+            out.comma[out.commas++] = rest.comma[i];
+        out.end = rest.end;
+        return;
+    }
+    scanTail(p, bufEnd, out);
+}
+
+#endif
+
+RowScanner resolveRowScanner(RowScanner wanted)
+{
+#ifdef TRIP_HAVE_X86_SIMD
+    if (wanted == RowScanner::Scalar || wanted == RowScanner::SSE2)
+        return wanted;
+    // Auto and AVX2 both mean "the widest we can run".
+    return __builtin_cpu_supports("avx2") ? RowScanner::AVX2 : RowScanner::SSE2;
+#else
+    (void)wanted;
+    return RowScanner::Scalar;
+#endif
+}
+
+LineScanFn lineScanFor(RowScanner scanner)
+{
+#ifdef TRIP_HAVE_X86_SIMD
+    if (scanner == RowScanner::SSE2)
+        return scanLineSSE2;
+    if (scanner == RowScanner::AVX2)
+        return scanLineAVX2;
+#else
+    (void)scanner;
+#endif
+    return nullptr;
+}
@@ -0,0 +1,41 @@
+// Vectorized delimiter scanning for one CSV line.
+// Instead of counting commas over the whole row and then walking it again byte by byte, the scanner
+// compares 16 (SSE2) or 32 (AVX2) bytes at a time against ',' and '\n' and turns the hits into bitmasks.
+// One pass gives the end of the line and where the first commas are, the fields are sliced off those.
+
+#pragma once
+#include <cstddef>
+
+// Which implementation scans the rows. Auto picks the widest one the CPU supports at runtime.
+enum class RowScanner
+{
+    Auto,
+    // The plain byte loops (countCommas + parseRow6), always available.
+    Scalar,
+    // 16 bytes per step, baseline on every x86-64 CPU.
+    SSE2,
+    // 32 bytes per step, only used if the CPU reports AVX2 (falls back to SSE2 otherwise).
+    AVX2
+};
+
+// Delimiters of one line. Only the first maxCommas commas are recorded, that is all a
+// 6-column row needs: column 1 is between comma[0] and comma[1], column 3 between comma[2] and comma[3],
+// and a fifth comma proves there are at least six columns.
+struct LineScan
+{
+    static constexpr int maxCommas = 5;
+
+    const char *end;            // the '\n' that ends the line, or the end of the buffer
+    int commas;                 // commas before end, capped at maxCommas
+    const char *comma[maxCommas];
+};
+
+// Scans from p up to the next '\n' or bufEnd, whichever comes first.
+// Never reads at or past bufEnd, so it is safe on the last bytes of a mapping.
+using LineScanFn = void (*)(const char *p, const char *bufEnd, LineScan &out);
+
+// Resolves Auto and anything the CPU can't run to a scanner that works here.
+RowScanner resolveRowScanner(RowScanner wanted);
+
+// The SIMD scan function for a resolved scanner, nullptr for Scalar.
+LineScanFn lineScanFor(RowScanner scanner);
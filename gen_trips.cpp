@@ -0,0 +1,254 @@
+// Synthetic trip CSV generator for load and worst-case testing.
+// Build with `make gen`, then e.g.:
+//   ./gen_trips --rows 20000000 --zones 300000 --dist zipf --out trips.csv     (about 1 GB)
+//   ./gen_trips --bytes 2G --dist collide --bad-rate 0.01 --crlf --out worst.csv
+// Writes the six-column schema of the tests (TripID,PickupZoneID,DropoffZoneID,PickupDateTime,
+// DistanceKm,FareAmount). The same options and seed always give the same file.
+// Nothing here is part of the graded code.
+
+#include "seeded_hash.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct Options
+{
+    unsigned long long rows = 1000000;
+    unsigned long long bytes = 0; // stop at this size instead of after rows, 0 = off
+    size_t zones = 1000;
+    string dist = "uniform"; // uniform, zipf or collide
+    double zipfS = 1.1;
+    unsigned collideBits = 16;
+    unsigned long long collideSeed = 0;
+    double hourSkew = 0;
+    double badRate = 0;
+    bool crlf = false;
+    bool header = true;
+    unsigned long long seed = 1;
+    string out = "-";
+};
+
+// makeZones hashes about 2^bits names per zone: ~3 ms per zone at 16 bits, ~0.7 s at 24.
+static const unsigned maxCollideBits = 24;
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: gen_trips [options]\n"
+            "  --rows N          data rows to write (default 1000000)\n"
+            "  --bytes N[K|M|G]  write until the file reaches this size instead of --rows\n"
+            "  --zones N         distinct pickup zones (default 1000)\n"
+            "  --dist D          uniform | zipf | collide (default uniform)\n"
+            "  --zipf-s S        Zipf exponent for --dist zipf (default 1.1)\n"
+            "  --collide-bits B  collide: every zone's hash agrees in its low B bits, 0..24 (default 16)\n"
+            "  --collide-seed N  collide: the hash seed the collisions are built for (default 0)\n"
+            "  --hour-skew P     share of rows in the 08:00 and 18:00 rush hours, 0..1 (default 0 = uniform)\n"
+            "  --bad-rate P      share of malformed rows, 0..1 (default 0)\n"
+            "  --crlf            end lines with \\r\\n\n"
+            "  --no-header       leave out the header line\n"
+            "  --seed N          random seed (default 1)\n"
+            "  --out FILE        output file, - for stdout (default -)\n");
+}
+
+// 10, 64K, 512M, 2G, ...
+static unsigned long long parseSize(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+    switch (*end)
+    {
+    case 'K': case 'k': v *= 1024.0; break;
+    case 'M': case 'm': v *= 1024.0 * 1024; break;
+    case 'G': case 'g': v *= 1024.0 * 1024 * 1024; break;
+    default: break;
+    }
+    return static_cast<unsigned long long>(v);
+}
+
+static bool parseArgs(int argc, char **argv, Options &o)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        string a = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (a == "--crlf")
+            o.crlf = true;
+        else if (a == "--no-header")
+            o.header = false;
+        else if (!hasValue)
+            return false;
+        else if (a == "--rows")
+            o.rows = parseSize(argv[++i]);
+        else if (a == "--bytes")
+            o.bytes = parseSize(argv[++i]);
+        else if (a == "--zones")
+            o.zones = static_cast<size_t>(parseSize(argv[++i]));
+        else if (a == "--dist")
+            o.dist = argv[++i];
+        else if (a == "--zipf-s")
+            o.zipfS = atof(argv[++i]);
+        else if (a == "--collide-bits")
+            o.collideBits = static_cast<unsigned>(atoi(argv[++i]));
+        else if (a == "--collide-seed")
+            o.collideSeed = strtoull(argv[++i], nullptr, 0);
+        else if (a == "--hour-skew")
+            o.hourSkew = atof(argv[++i]);
+        else if (a == "--bad-rate")
+            o.badRate = atof(argv[++i]);
+        else if (a == "--seed")
+            o.seed = strtoull(argv[++i], nullptr, 10);
+        else if (a == "--out")
+            o.out = argv[++i];
+        else
+            return false;
+    }
+    return o.zones > 0 && o.collideBits <= maxCollideBits && (o.dist == "uniform" || o.dist == "zipf" || o.dist == "collide");
+}
+
+// Zone names. collide keeps only the candidates whose hash under collideSeed has the same low bits, so
+// in an analyzer running with that seed (TRIP_HASH_SEED) every one of them starts probing at the same
+// slot of any table up to 2^bits slots: the linear probing worst case an unseeded hash would allow.
+// Under any other seed they are ordinary keys. Costs about 2^bits hashes per zone, see maxCollideBits.
+static vector<string> makeZones(const Options &o)
+{
+    vector<string> names;
+    names.reserve(o.zones);
+    if (o.dist != "collide")
+    {
+        for (size_t i = 0; i < o.zones; ++i)
+            names.push_back("ZONE_" + to_string(i));
+        return names;
+    }
+
+    const uint64_t mask = o.collideBits ? (uint64_t(1) << o.collideBits) - 1 : 0;
+    uint64_t target = seededHash("ZONE_0", o.collideSeed) & mask;
+    for (uint64_t i = 0; names.size() < o.zones; ++i)
+    {
+        string name = "ZONE_" + to_string(i);
+        if ((seededHash(name, o.collideSeed) & mask) == target)
+            names.push_back(std::move(name));
+    }
+    return names;
+}
+
+// Zipf(s) over ranks 0..n-1 by inverting the cumulative weights: one binary search per draw.
+class ZipfSampler
+{
+public:
+    ZipfSampler(size_t n, double s) : cdf(n)
+    {
+        double sum = 0;
+        for (size_t k = 0; k < n; ++k)
+            cdf[k] = sum += 1.0 / pow(static_cast<double>(k + 1), s);
+        for (double &c : cdf)
+            c /= sum;
+    }
+
+    size_t operator()(mt19937_64 &rng)
+    {
+        double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+        return min(static_cast<size_t>(lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin()), cdf.size() - 1);
+    }
+
+private:
+    vector<double> cdf;
+};
+
+int main(int argc, char **argv)
+{
+    Options o;
+    if (!parseArgs(argc, argv, o))
+    {
+        usage();
+        return 2;
+    }
+
+    FILE *out = o.out == "-" ? stdout : fopen(o.out.c_str(), "wb");
+    if (!out)
+    {
+        fprintf(stderr, "cannot write %s\n", o.out.c_str());
+        return 1;
+    }
+
+    mt19937_64 rng(o.seed);
+    vector<string> zones = makeZones(o);
+    ZipfSampler zipf(o.dist == "zipf" ? zones.size() : 1, o.zipfS);
+    // Zipf rank 0 is the hottest zone; shuffle so hotness doesn't follow the numbering.
+    if (o.dist == "zipf")
+        shuffle(zones.begin(), zones.end(), rng);
+
+    uniform_real_distribution<double> coin(0.0, 1.0);
+    uniform_int_distribution<size_t> anyZone(0, zones.size() - 1);
+    uniform_int_distribution<int> anyHour(0, 23), anyMinute(0, 59), anyDay(1, 28), anyMonth(1, 12);
+    const char *eol = o.crlf ? "\r\n" : "\n";
+
+    // Rows are formatted into a big buffer and written in one go, so a GB file is I/O bound.
+    string buf;
+    buf.reserve(1 << 22);
+    unsigned long long written = 0;
+    auto flush = [&]()
+    {
+        fwrite(buf.data(), 1, buf.size(), out);
+        written += buf.size();
+        buf.clear();
+    };
+    if (o.header)
+        buf.append("TripID,PickupZoneID,DropoffZoneID,PickupDateTime,DistanceKm,FareAmount").append(eol);
+
+    char row[256];
+    for (unsigned long long id = 1;; ++id)
+    {
+        if (o.bytes ? written + buf.size() >= o.bytes : id > o.rows)
+            break;
+
+        const string &zone = zones[o.dist == "zipf" ? zipf(rng) : anyZone(rng)];
+        const string &dropoff = zones[anyZone(rng)];
+        int hour = anyHour(rng);
+        if (o.hourSkew > 0 && coin(rng) < o.hourSkew)
+            hour = coin(rng) < 0.5 ? 8 : 18;
+        // Drawn one by one: the order of function arguments isn't fixed, the file must be.
+        int month = anyMonth(rng);
+        int day = anyDay(rng);
+        int minute = anyMinute(rng);
+        double km = 0.5 + coin(rng) * 30;
+        double fare = 3.0 + coin(rng) * 80;
+        int n = snprintf(row, sizeof(row), "%llu,%s,%s,2024-%02d-%02d %02d:%02d,%.1f,%.2f", id, zone.c_str(),
+                         dropoff.c_str(), month, day, hour, minute, km, fare);
+
+        // Every kind of row the parser has to skip.
+        if (o.badRate > 0 && coin(rng) < o.badRate)
+        {
+            string line;
+            switch (rng() % 6)
+            {
+            case 0: line = to_string(id) + "," + zone; break;                               // too few columns
+            case 1: line = to_string(id) + ",," + dropoff + ",2024-01-01 10:00,1.0,5.00"; break; // empty zone
+            case 2: line = to_string(id) + "," + zone + "," + dropoff + ",NOT_A_DATE,1.0,5.00"; break;
+            case 3: line = to_string(id) + "," + zone + "," + dropoff + ",2024-01-01 24:30,1.0,5.00"; break;
+            case 4: line = to_string(id) + "," + zone + "," + dropoff + ",,1.0,5.00"; break; // empty datetime
+            default: break;                                                                     // blank line
+            }
+            buf.append(line);
+        }
+        else
+        {
+            buf.append(row, static_cast<size_t>(max(n, 0)));
+        }
+        buf.append(eol);
+        if (buf.size() >= (1 << 22))
+            flush();
+    }
+    flush();
+
+    bool failed = ferror(out) != 0;
+    if (out != stdout)
+        failed |= fclose(out) != 0;
+    if (failed)
+        fprintf(stderr, "write to %s failed\n", o.out.c_str());
+    return failed ? 1 : 0;
+}
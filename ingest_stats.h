@@ -0,0 +1,81 @@
+// Counters and phase timers of the ingest path, for telling an I/O bound ingest from a parse bound one
+// or from a rehash storm. Opt-in at compile time: build with -DTRIP_STATS=1 (make STATS=1) and every
+// ingest fills TripAnalyzer::ingestStats(). Without it the helpers below are empty inline functions,
+// so the hot loops compile to exactly what they were and every field stays 0.
+// All translation units of one program must agree on TRIP_STATS.
+
+#pragma once
+#include <cstdint>
+
+#ifndef TRIP_STATS
+#define TRIP_STATS 0
+#endif
+
+#if TRIP_STATS
+#include <chrono>
+#endif
+
+struct IngestStats
+{
+    uint64_t bytesRead = 0;    // input bytes handed to the analyzer, header and bad rows included
+    uint64_t rowsSeen = 0;     // non-empty lines other than the header
+    uint64_t rowsAccepted = 0; // rows that were counted
+
+    // Skipped rows by the first check they failed; together they make rowsSeen - rowsAccepted.
+    uint64_t rejectedFewCommas = 0;   // fewer than the five commas of six columns
+    uint64_t rejectedEmptyZone = 0;   // blank PickupZoneID
+    uint64_t rejectedBadDatetime = 0; // PickupDateTime without a "date HH" hour in it
+    uint64_t rejectedHourRange = 0;   // an hour, but past 23
+
+    // Wall time in nanoseconds. Time of worker threads adds up, so a Parallel, Pipelined or concurrent
+    // ingest can report more than the elapsed time. Mapped files are read by the page faults of the
+    // parser, so their reads show up in parseNs and readNs only holds the open/mmap/munmap calls.
+    // Stream mode reads the clock around every line and runs about half as fast with stats on; the
+    // other modes time blocks of rows and lose ~10%.
+    uint64_t readNs = 0;
+    uint64_t parseNs = 0;     // splitting rows and extracting (zone, hour)
+    uint64_t aggregateNs = 0; // counting accepted rows, rehashNs not included
+    uint64_t rehashNs = 0;
+
+    // Times the zone table or the per-zone counters grew and moved the zones already in them.
+    uint64_t rehashes = 0;
+
+    IngestStats &operator+=(const IngestStats &o)
+    {
+        bytesRead += o.bytesRead;
+        rowsSeen += o.rowsSeen;
+        rowsAccepted += o.rowsAccepted;
+        rejectedFewCommas += o.rejectedFewCommas;
+        rejectedEmptyZone += o.rejectedEmptyZone;
+        rejectedBadDatetime += o.rejectedBadDatetime;
+        rejectedHourRange += o.rejectedHourRange;
+        readNs += o.readNs;
+        parseNs += o.parseNs;
+        aggregateNs += o.aggregateNs;
+        rehashNs += o.rehashNs;
+        rehashes += o.rehashes;
+        return *this;
+    }
+};
+
+// field += n, or nothing without TRIP_STATS.
+inline void statAdd(uint64_t &field, uint64_t n)
+{
+#if TRIP_STATS
+    field += n;
+#else
+    (void)field;
+    (void)n;
+#endif
+}
+
+// A steady clock in nanoseconds for the phase timers, always 0 without TRIP_STATS.
+inline uint64_t statClock()
+{
+#if TRIP_STATS
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#else
+    return 0;
+#endif
+}
@@ -1,6 +1,11 @@
 #include "analyzer.h"
+#include "perf_counters.h"
 #include <iostream>
 #include <chrono>
+#include <climits>
+#include <algorithm>
+#include <cstdio>
+#include <string>
 
 static void printZones(const std::vector<ZoneCount>& v) {
     std::cout << "TOP_ZONES\n";
@@ -14,18 +19,107 @@ static void printSlots(const std::vector<SlotCount>& v) {
         std::cout << x.zone << "," << x.hour << "," << x.count << "\n";
 }
 
-int main() {
+// One phase under --profile: its wall time and the counters around it.
+struct PhaseSample {
+    const char* name;
+    double ms;
+    uint64_t values[PerfCounters::eventCount];
+};
+
+// Trips the analyzer accepted, the denominator of the per-row ratios. The header and rejected lines
+// don't count, so a file full of bad rows doesn't make the parser look cheap. Summed after the phases.
+static unsigned long long countTrips(const TripAnalyzer& analyzer) {
+    unsigned long long trips = 0;
+    for (const auto& z : analyzer.topZones(INT_MAX))
+        trips += static_cast<unsigned long long>(z.count);
+    return trips;
+}
+
+// Per phase: wall time and every counter per accepted row, plus instructions per cycle. "n/a" for counters that didn't open.
+static void printProfile(const PerfCounters& counters, const std::vector<PhaseSample>& samples, unsigned long long rows) {
+    std::cout << "PROFILE\n";
+    if (!counters.error().empty())
+        std::cout << "# unavailable: " << counters.error() << "\n";
+    std::cout << "# " << rows << " accepted rows, counts per row\n";
+    std::cout << "phase,ms";
+    for (int e = 0; e < PerfCounters::eventCount; ++e)
+        std::cout << "," << PerfCounters::name(static_cast<PerfCounters::Event>(e));
+    std::cout << ",ipc\n";
+
+    double perRow = 1.0 / static_cast<double>(std::max(rows, 1ULL));
+    char num[32];
+    for (const auto& s : samples) {
+        std::snprintf(num, sizeof(num), "%.3f", s.ms);
+        std::cout << s.name << "," << num;
+        for (int e = 0; e < PerfCounters::eventCount; ++e) {
+            if (counters.available(static_cast<PerfCounters::Event>(e)))
+                std::snprintf(num, sizeof(num), "%.4f", static_cast<double>(s.values[e]) * perRow);
+            else
+                std::snprintf(num, sizeof(num), "n/a");
+            std::cout << "," << num;
+        }
+        uint64_t cycles = s.values[PerfCounters::Cycles];
+        if (cycles && counters.available(PerfCounters::Instructions))
+            std::snprintf(num, sizeof(num), "%.2f", static_cast<double>(s.values[PerfCounters::Instructions]) / cycles);
+        else
+            std::snprintf(num, sizeof(num), "n/a");
+        std::cout << "," << num << "\n";
+    }
+}
+
+// ./app [--profile] [file.csv]
+// --profile adds a PROFILE section after EXEC_MS with hardware counters (perf_counters.h) per phase.
+int main(int argc, char** argv) {
+    bool profile = false;
+    std::string path = "SmallTrips.csv";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--profile") {
+            profile = true;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            std::cerr << "unknown option " << arg << "\nusage: " << argv[0] << " [--profile] [file.csv]\n";
+            return 2;
+        } else {
+            path = arg;
+        }
+    }
+
+    PerfCounters counters;
+    std::vector<PhaseSample> samples;
+    if (profile)
+        counters.open();
+    auto phase = [&](const char* name, auto&& run) {
+        if (!profile) {
+            run();
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        counters.start();
+        run();
+        counters.stop();
+        PhaseSample s{name, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), {}};
+        for (int e = 0; e < PerfCounters::eventCount; ++e)
+            s.values[e] = counters.value(static_cast<PerfCounters::Event>(e));
+        samples.push_back(s);
+    };
+
     auto t0 = std::chrono::high_resolution_clock::now();
 
     TripAnalyzer analyzer;
-    analyzer.ingestFile("SmallTrips.csv");
+    std::vector<ZoneCount> zones;
+    std::vector<SlotCount> slots;
+    phase("ingest", [&] { analyzer.ingestFile(path); });
+    phase("topZones", [&] { zones = analyzer.topZones(10); });
+    phase("topBusySlots", [&] { slots = analyzer.topBusySlots(10); });
 
-    printZones(analyzer.topZones(10));
-    printSlots(analyzer.topBusySlots(10));
+    printZones(zones);
+    printSlots(slots);
 
     auto t1 = std::chrono::high_resolution_clock::now();
     auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
 
     std::cout << "EXEC_MS\n" << ms << "\n";
+    if (profile)
+        printProfile(counters, samples, countTrips(analyzer));
     return 0;
 }
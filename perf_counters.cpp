@@ -0,0 +1,136 @@
+// perf_event_open wrapper behind PerfCounters. See perf_counters.h.
+
+#include "perf_counters.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#define TRIP_HAVE_PERF 1
+#endif
+
+using namespace std;
+
+const char *PerfCounters::name(Event e)
+{
+    static const char *const names[eventCount] = {"cycles", "instr", "llc-miss", "br-miss", "dtlb-miss"};
+    return names[e];
+}
+
+#ifdef TRIP_HAVE_PERF
+
+// glibc has no wrapper for this syscall.
+static int perfEventOpen(perf_event_attr &attr)
+{
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+bool PerfCounters::open()
+{
+    struct Config
+    {
+        uint32_t type;
+        uint64_t config;
+    };
+    // "cache-misses" is the last-level cache on every PMU perf knows; dTLB counts load misses only.
+    static const Config configs[eventCount] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    };
+
+    bool any = false;
+    for (int e = 0; e < eventCount; ++e)
+    {
+        if (fds[e] >= 0)
+        {
+            any = true;
+            continue;
+        }
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = configs[e].type;
+        attr.config = configs[e].config;
+        attr.disabled = 1;
+        // User space only: that is all perf_event_paranoid 2 allows, and the parser lives there anyway.
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // Also count the worker threads of IngestMode::Parallel and Pipelined.
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds[e] = perfEventOpen(attr);
+        if (fds[e] >= 0)
+            any = true;
+        else if (firstError.empty())
+        {
+            int err = errno;
+            firstError = string(name(static_cast<Event>(e))) + ": " + strerror(err) +
+                         (err == EACCES || err == EPERM          ? " (perf_event_paranoid or seccomp)"
+                          : err == ENOENT || err == EOPNOTSUPP ? " (no hardware PMU here, e.g. a VM or container)"
+                                                               : "");
+        }
+    }
+    return any;
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int fd : fds)
+        if (fd >= 0)
+            close(fd);
+}
+
+void PerfCounters::start()
+{
+    for (int fd : fds)
+    {
+        if (fd < 0)
+            continue;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void PerfCounters::stop()
+{
+    for (int e = 0; e < eventCount; ++e)
+    {
+        values[e] = 0;
+        if (fds[e] < 0)
+            continue;
+        ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        // value, time enabled, time running. More counters than the PMU has are time-sliced,
+        // so the count is extrapolated to the whole time it was enabled.
+        uint64_t buf[3] = {};
+        if (read(fds[e], buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)) || buf[2] == 0)
+            continue;
+        values[e] = buf[2] < buf[1] ? static_cast<uint64_t>(static_cast<double>(buf[0]) * buf[1] / buf[2]) : buf[0];
+    }
+}
+
+#else
+
+bool PerfCounters::open()
+{
+    firstError = "perf_event_open is Linux only";
+    return false;
+}
+
+PerfCounters::~PerfCounters() = default;
+
+void PerfCounters::start()
+{
+}
+
+void PerfCounters::stop()
+{
+}
+
+#endif
@@ -0,0 +1,238 @@
+// HELPERS AND PARSING FUNCTIONS
+// Every helper works on a [begin, end) byte range, so the same code can run over a std::string
+// filled by getline or directly over a memory-mapped file without copying the row first.
+// They live in a header so the benchmarks can time them one by one, only analyzer.cpp uses them for real.
+
+#pragma once
+#include "csv_scan.h"
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TRIP_HAVE_SSE2 1
+#endif
+
+// Clean up r
+inline void stripTrailingCR(const char *s, const char *&e)
+{
+    if (e > s && e[-1] == '\r')
+        --e;
+}
+
+// A little check of a the data row, we shouldn't waste time attempting to parse it if there aren't at least five commas because there are missing columns.
+inline int countCommas(const char *s, const char *e)
+{
+    int commas = 0;
+    for (const char *p = s; p < e; ++p)
+        if (*p == ',')
+            ++commas;
+    return commas;
+}
+
+// Digs into the "YYYY-MM-DD HH:MM" string to find JUST the hour.
+// The general version: copes with any date text, several spaces and any number of hour digits.
+inline int parseHourGeneral(const char *p, const char *e)
+{
+    // move to the space between date and time
+    while (p < e && *p != ' ' && *p != ',')
+        ++p;
+
+    // If we hit a comma here or the end of the line before finding a space, the format is wrong.
+    if (p == e || *p == ',')
+        return -1;
+
+    // skip space to get HH part.
+    while (p < e && *p == ' ')
+        ++p;
+
+    // now at HH:MM
+    if (p == e || !isdigit(static_cast<unsigned char>(*p)))
+        return -1;
+
+    int hour = 0;
+    while (p < e && isdigit(static_cast<unsigned char>(*p)))
+    {
+        hour = hour * 10 + (*p - '0');
+        // Anything past two digits is already out of range, stop before the int overflows.
+        if (hour > 23)
+            return -1;
+        ++p;
+    }
+    // check hour range
+    if (hour < 0 || hour > 23)
+        return -1;
+    return hour;
+}
+
+// Fast path for the layout nearly every row uses: exactly "YYYY-MM-DD HH:MM" at the start of the field.
+// Checks all 16 bytes at once (digits where digits go, '-', '-', ' ', ':' where they go) and then reads
+// HH from fixed offsets. Returns -2 if the field doesn't have that layout so the caller can fall back.
+// Whenever the layout matches, parseHourGeneral would stop at the ' ' at [10] and read exactly the two
+// digits at [11] and [12], so both always agree.
+inline int parseHourFixedLayout(const char *p, const char *e)
+{
+    if (e - p < 16)
+        return -2;
+
+#ifdef TRIP_HAVE_SSE2
+    static const char pattern[16] = {'0', '0', '0', '0', '-', '0', '0', '-', '0', '0', ' ', '0', '0', ':', '0', '0'};
+    // bit i set = byte i must be a digit, the other bytes must equal pattern exactly.
+    const unsigned digitBits = 0xDB6F; // 1101 1011 0110 1111: positions 0-3, 5-6, 8-9, 11-12, 14-15
+
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    // unsigned d <= 9 <=> min(d, 9) == d
+    __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    __m128i isSep = _mm_cmpeq_epi8(v, _mm_loadu_si128(reinterpret_cast<const __m128i *>(pattern)));
+    unsigned digits = static_cast<unsigned>(_mm_movemask_epi8(isDigit));
+    unsigned seps = static_cast<unsigned>(_mm_movemask_epi8(isSep));
+    if (((digits & digitBits) | (seps & ~digitBits & 0xFFFF)) != 0xFFFF)
+        return -2;
+#else
+    for (int i = 0; i < 16; ++i)
+    {
+        bool ok = (i == 4 || i == 7) ? p[i] == '-'
+                  : i == 10          ? p[i] == ' '
+                  : i == 13          ? p[i] == ':'
+                                     : (p[i] >= '0' && p[i] <= '9');
+        if (!ok)
+            return -2;
+    }
+#endif
+
+    // Branchless: the compiler turns the range check into a conditional move.
+    int hour = (p[11] - '0') * 10 + (p[12] - '0');
+    return hour <= 23 ? hour : -1;
+}
+
+// The hour of a PickupDateTime field, or -1 if it has none.
+inline int parseHourFromDatetime(const char *p, const char *e)
+{
+    int hour = parseHourFixedLayout(p, e);
+    return hour != -2 ? hour : parseHourGeneral(p, e);
+}
+
+// Extract PickupZoneID (column 1) and hour(from column 3) from a 6-column data row.
+// Returns true if the row is usable, false if it should be skipped with the main Slicer Grgabs the zone ID and the hour from a single line of the data.
+inline bool parseRow6(const char *buf, const char *e, std::string_view &zoneOut, int &hourOut)
+{
+    const char *p = buf;
+
+    // Quick check for malformed rows.
+    // Validation space
+    if (countCommas(buf, e) < 5)
+        return false;
+
+    // 1Skip Column 0 the (TripID) by running until we hit the first other comma.
+    while (p < e && *p != ',')
+        ++p;
+    if (p == e)
+        return false;
+    ++p; // skip comma
+
+    // 2Extract column 1 PickupZoneID
+    while (p < e && (*p == ' ' || *p == '\t'))
+        ++p;
+    const char *zoneStart = p;
+    while (p < e && *p != ',')
+        ++p;
+    if (p == e)
+        return false;
+
+    // A clean up trailing spaces
+    const char *zoneEnd = p;
+    while (zoneEnd > zoneStart && (zoneEnd[-1] == ' ' || zoneEnd[-1] == '\t'))
+        --zoneEnd;
+    if (zoneStart == zoneEnd)
+        return false;
+
+    zoneOut = std::string_view(zoneStart, zoneEnd - zoneStart);
+    ++p; // skip comma
+
+    // 3We skip Column 2 the (DropoffZoneID) and then we don't need it for this analysis.
+    while (p < e && *p != ',')
+        ++p;
+    if (p == e)
+        return false;
+    ++p;
+
+    // 4Parse the hour from Column 3 the (PickupDateTime).
+    hourOut = parseHourFromDatetime(p, e);
+    if (hourOut < 0)
+        return false;
+
+    return true; // success
+}
+
+// parseRow6 for a line the SIMD scanner already split. Accepts and rejects exactly the same rows:
+// parseRow6 needs five commas, finds the zone between the first two and the datetime after the third,
+// and its hour parser stops at the fourth comma anyway.
+inline bool parseScannedRow(const LineScan &ls, std::string_view &zoneOut, int &hourOut)
+{
+    if (ls.commas < 5)
+        return false;
+
+    const char *zoneStart = ls.comma[0] + 1;
+    const char *zoneEnd = ls.comma[1];
+    while (zoneStart < zoneEnd && (*zoneStart == ' ' || *zoneStart == '\t'))
+        ++zoneStart;
+    while (zoneEnd > zoneStart && (zoneEnd[-1] == ' ' || zoneEnd[-1] == '\t'))
+        --zoneEnd;
+    if (zoneStart == zoneEnd)
+        return false;
+    zoneOut = std::string_view(zoneStart, zoneEnd - zoneStart);
+
+    hourOut = parseHourFromDatetime(ls.comma[2] + 1, ls.comma[3]);
+    return hourOut >= 0;
+}
+
+// Why parseRow6 / parseScannedRow turned a data line down.
+enum class RowReject
+{
+    FewCommas,
+    EmptyZone,
+    BadDatetime,
+    HourRange
+};
+
+// Walks a rejected line again to find the first check it failed. Only the ingest stats call this, and
+// only for rejected rows, so accepted rows never pay for the finer split.
+inline RowReject classifyRejectedRow(const char *s, const char *e)
+{
+    if (countCommas(s, e) < 5)
+        return RowReject::FewCommas;
+
+    const char *zoneStart = std::find(s, e, ',') + 1;
+    const char *zoneEnd = std::find(zoneStart, e, ',');
+    while (zoneStart < zoneEnd && (*zoneStart == ' ' || *zoneStart == '\t'))
+        ++zoneStart;
+    if (zoneStart == zoneEnd)
+        return RowReject::EmptyZone;
+
+    // Same walk as parseHourGeneral (the fixed layout always agrees with it): if it gets as far as the
+    // digits of the hour, the only thing left to fail on was the range.
+    const char *p = std::find(zoneEnd + 1, e, ',') + 1;
+    const char *fieldEnd = std::find(p, e, ',');
+    p = std::find(p, fieldEnd, ' ');
+    while (p < fieldEnd && *p == ' ')
+        ++p;
+    if (p < fieldEnd && isdigit(static_cast<unsigned char>(*p)))
+        return RowReject::HourRange;
+    return RowReject::BadDatetime;
+}
+
+// True if the first line of a file looks like the CSV header rather than a trip.
+inline bool looksLikeHeader(const char *s, const char *e)
+{
+    static const char key[] = "TripID";
+    if (std::search(s, e, key, key + sizeof(key) - 1) != e)
+        return true;
+
+    // Backup check: if first field isn't a digit, it's probably a header row
+    while (s < e && (*s == ' ' || *s == '\t'))
+        ++s;
+    return s == e || !isdigit(static_cast<unsigned char>(*s));
+}
+
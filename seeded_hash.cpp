@@ -0,0 +1,21 @@
+// Process seed of seededHash, see seeded_hash.h.
+
+#include "seeded_hash.h"
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+uint64_t randomHashSeed()
+{
+    if (const char *pinned = std::getenv("TRIP_HASH_SEED"))
+        return std::strtoull(pinned, nullptr, 0);
+
+    // random_device alone may be a fixed sequence on some platforms, so the clock and the address of
+    // a local (ASLR) go in too.
+    std::random_device rd;
+    uint64_t seed = (uint64_t(rd()) << 32) ^ rd();
+    seed ^= static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    int local = 0;
+    seed ^= reinterpret_cast<uintptr_t>(&local) * 0x9E3779B97F4A7C15ull;
+    return seed;
+}
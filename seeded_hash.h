@@ -0,0 +1,144 @@
+// Seeded 64-bit string hash for every key that comes from the input (zone names and what is built on them).
+// It follows wyhash: the bytes are read 8 at a time and folded with 64x64 -> 128-bit multiplies
+// whose halves are xored together ("mum"), with the seed mixed in first. Short keys take one branch.
+//
+// The seed is drawn at random once per process, so whoever produces the CSV can't precompute zone IDs
+// that pile up in one probe chain (see --dist collide in gen_trips). TRIP_HASH_SEED=<n> in the
+// environment pins it for reproducible runs.
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace seeded_hash_detail
+{
+// a * b as a full 128-bit product: a gets the low half, b the high half.
+inline void mul128(uint64_t &a, uint64_t &b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    a = static_cast<uint64_t>(r);
+    b = static_cast<uint64_t>(r >> 64);
+#else
+    uint64_t ha = a >> 32, la = a & 0xFFFFFFFFull, hb = b >> 32, lb = b & 0xFFFFFFFFull;
+    uint64_t hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+    uint64_t mid = (ll >> 32) + (hl & 0xFFFFFFFFull) + (lh & 0xFFFFFFFFull);
+    a = (ll & 0xFFFFFFFFull) | (mid << 32);
+    b = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+#endif
+}
+
+// The two halves of a * b folded into one word.
+inline uint64_t mum(uint64_t a, uint64_t b)
+{
+    mul128(a, b);
+    return a ^ b;
+}
+
+inline uint64_t read64(const char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint64_t read32(const char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+constexpr uint64_t k0 = 0xa0761d6478bd642full;
+constexpr uint64_t k1 = 0xe7037ed1a0b428dbull;
+constexpr uint64_t k2 = 0x8ebc6af09c88c6e3ull;
+constexpr uint64_t k3 = 0x589965cc75374cc3ull;
+} // namespace seeded_hash_detail
+
+inline uint64_t seededHash(std::string_view key, uint64_t seed)
+{
+    using namespace seeded_hash_detail;
+    const char *p = key.data();
+    size_t n = key.size();
+    seed ^= mum(seed ^ k0, k1);
+
+    uint64_t a, b;
+    if (n <= 16)
+    {
+        if (n >= 4)
+        {
+            // Two overlapping 4-byte reads from each end cover every byte of 4..16.
+            size_t mid = (n >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + mid);
+            b = (read32(p + n - 4) << 32) | read32(p + n - 4 - mid);
+        }
+        else if (n > 0)
+        {
+            a = (uint64_t(static_cast<unsigned char>(p[0])) << 16) | (uint64_t(static_cast<unsigned char>(p[n >> 1])) << 8) |
+                static_cast<unsigned char>(p[n - 1]);
+            b = 0;
+        }
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t i = n;
+        if (i > 48)
+        {
+            uint64_t s1 = seed, s2 = seed;
+            do
+            {
+                seed = mum(read64(p) ^ k1, read64(p + 8) ^ seed);
+                s1 = mum(read64(p + 16) ^ k2, read64(p + 24) ^ s1);
+                s2 = mum(read64(p + 32) ^ k3, read64(p + 40) ^ s2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= s1 ^ s2;
+        }
+        while (i > 16)
+        {
+            seed = mum(read64(p) ^ k1, read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        // The last 16 bytes of the key, overlapping what the loop already took if need be.
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    a ^= k1;
+    b ^= seed;
+    mul128(a, b);
+    return mum(a ^ k0 ^ n, b ^ k1);
+}
+
+// The process-wide seed: TRIP_HASH_SEED if set, random otherwise.
+uint64_t randomHashSeed();
+
+inline uint64_t &hashSeedStorage()
+{
+    static uint64_t seed = randomHashSeed();
+    return seed;
+}
+
+inline uint64_t hashSeed()
+{
+    return hashSeedStorage();
+}
+
+// Replaces the process seed, for reproducible tests and benchmarks. Every zone table, sketch and summary
+// keeps the hashes it was built with, so only call this while no analyzer holds any data.
+inline void setHashSeed(uint64_t seed)
+{
+    hashSeedStorage() = seed;
+}
+
+// For unordered containers keyed by input strings.
+struct SeededStringHash
+{
+    size_t operator()(std::string_view key) const { return static_cast<size_t>(seededHash(key, hashSeed())); }
+};
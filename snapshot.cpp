@@ -0,0 +1,201 @@
+// Binary snapshots of the aggregated counts, so a restart doesn't have to re-parse the CSVs.
+//
+// Layout (all integers little-endian, whatever the host is):
+//   "TRIPSNAP"                    8 bytes magic
+//   u32 version                   snapshotVersion
+//   u32 hours                     always 24, guards against a build with another histogram size
+//   u64 zones                     number of zones, in id order
+//   u32 nameLength[zones]         then all zone names back to back, no separators
+//   per zone: u32 hourMask        bit h set = hour h has a non-zero count
+//             u64 count[popcount] the non-zero hour counts, lowest hour first
+//   u64 checksum                  snapshotChecksum of every byte before it
+// Zone totals are not stored, they are always the sum of the hourly counts.
+
+#include "analyzer.h"
+#include <fstream>
+#include <cstring>
+using namespace std;
+
+static const char snapshotMagic[8] = {'T', 'R', 'I', 'P', 'S', 'N', 'A', 'P'};
+static const uint32_t snapshotVersion = 1;
+
+// FNV-1a style, but over 8-byte little-endian words in four independent lanes so it runs at memory
+// speed on a multi-megabyte snapshot. It only has to catch truncation and flipped bits, not attacks.
+static uint64_t snapshotChecksum(const char *p, size_t n)
+{
+    const uint64_t prime = 0x100000001B3ull;
+    uint64_t lane[4] = {0xCBF29CE484222325ull, 0x84222325CBF29CE4ull, 0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full};
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        for (int k = 0; k < 4; ++k)
+        {
+            uint64_t w = 0;
+            for (int b = 0; b < 8; ++b)
+                w |= static_cast<uint64_t>(static_cast<unsigned char>(p[i + 8 * k + b])) << (8 * b);
+            lane[k] = (lane[k] ^ w) * prime;
+        }
+    }
+    uint64_t h = n;
+    for (int k = 0; k < 4; ++k)
+        h = (h ^ lane[k]) * prime;
+    for (; i < n; ++i)
+        h = (h ^ static_cast<unsigned char>(p[i])) * prime;
+    return h;
+}
+
+static void putU32(string &out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        out.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+static void putU64(string &out, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i)
+        out.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+// Bounds-checked little-endian reader over the loaded bytes. Any read past the end
+// just flips ok to false, so the parser can check once at the end of a section.
+struct SnapshotReader
+{
+    const char *p;
+    const char *end;
+    bool ok = true;
+
+    uint64_t get(int bytes)
+    {
+        if (end - p < bytes)
+        {
+            ok = false;
+            p = end;
+            return 0;
+        }
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; ++i)
+            v |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+        p += bytes;
+        return v;
+    }
+};
+
+bool TripAnalyzer::saveSnapshot(const std::string &path) const
+{
+    // A summary's estimates are not counts, they don't fit this format.
+    if (approxCapacity || !exactCounts)
+        return false;
+
+    // Built in memory and written with one call, the file is small next to the CSVs it replaces.
+    string out;
+    out.append(snapshotMagic, sizeof(snapshotMagic));
+    putU32(out, snapshotVersion);
+    putU32(out, hoursPerDay);
+    putU64(out, zones.size());
+
+    for (uint32_t id = 0; id < zones.size(); ++id)
+        putU32(out, static_cast<uint32_t>(zones.name(id).size()));
+    for (uint32_t id = 0; id < zones.size(); ++id)
+        out += zones.name(id);
+
+    for (const ZoneStats &st : zoneStats)
+    {
+        uint32_t mask = 0;
+        for (int h = 0; h < hoursPerDay; ++h)
+            if (st.hours[h] != 0)
+                mask |= 1u << h;
+        putU32(out, mask);
+        for (int h = 0; h < hoursPerDay; ++h)
+            if (st.hours[h] != 0)
+                putU64(out, static_cast<uint64_t>(st.hours[h]));
+    }
+
+    putU64(out, snapshotChecksum(out.data(), out.size()));
+
+    ofstream file(path, ios::binary | ios::trunc);
+    if (!file.is_open())
+        return false;
+    file.write(out.data(), static_cast<streamsize>(out.size()));
+    return static_cast<bool>(file);
+}
+
+bool TripAnalyzer::loadSnapshot(const std::string &path)
+{
+    if (approxCapacity || !exactCounts)
+        return false;
+
+    // One sequential read of the whole file, then everything is parsed from memory.
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file.is_open())
+        return false;
+    streamoff size = file.tellg();
+    if (size <= 0)
+        return false;
+    string data(static_cast<size_t>(size), '\0');
+    file.seekg(0);
+    if (!file.read(&data[0], size))
+        return false;
+
+    const size_t fixedHeader = sizeof(snapshotMagic) + 4 + 4 + 8;
+    if (data.size() < fixedHeader + 8 || memcmp(data.data(), snapshotMagic, sizeof(snapshotMagic)) != 0)
+        return false;
+
+    SnapshotReader in{data.data() + sizeof(snapshotMagic), data.data() + data.size() - 8};
+    SnapshotReader tail{data.data() + data.size() - 8, data.data() + data.size()};
+    if (tail.get(8) != snapshotChecksum(data.data(), data.size() - 8))
+        return false;
+    if (in.get(4) != snapshotVersion || in.get(4) != static_cast<uint64_t>(hoursPerDay))
+        return false;
+
+    uint64_t count = in.get(8);
+    // Every zone needs at least a 4-byte length and a 4-byte mask, so a bigger count is a lie.
+    if (!in.ok || count > static_cast<uint64_t>(in.end - in.p) / 8)
+        return false;
+
+    // Decode into a fresh analyzer, so a bad file leaves this one untouched.
+    TripAnalyzer loaded;
+    loaded.zones.reserve(static_cast<size_t>(count));
+    loaded.zoneStats.reserve(static_cast<size_t>(count));
+
+    vector<uint32_t> lengths(static_cast<size_t>(count));
+    for (auto &len : lengths)
+        len = static_cast<uint32_t>(in.get(4));
+    for (uint32_t len : lengths)
+    {
+        if (!in.ok || static_cast<uint64_t>(in.end - in.p) < len)
+            return false;
+        // Ids come back in the saved order because every name is new to the fresh dictionary.
+        if (loaded.zones.intern(string_view(in.p, len)) != loaded.zoneStats.size())
+            return false; // duplicate zone name
+        loaded.zoneStats.emplace_back();
+        in.p += len;
+    }
+
+    for (ZoneStats &st : loaded.zoneStats)
+    {
+        uint32_t mask = static_cast<uint32_t>(in.get(4));
+        if (mask >> hoursPerDay)
+            return false;
+        for (int h = 0; h < hoursPerDay; ++h)
+        {
+            if (mask & (1u << h))
+            {
+                st.hours[h] = static_cast<long long>(in.get(8));
+                st.total += st.hours[h];
+            }
+        }
+    }
+    if (!in.ok || in.p != in.end)
+        return false;
+
+    // Only the counts are replaced, the ingest settings of this analyzer stay as they are.
+    zones = std::move(loaded.zones);
+    zoneStats = std::move(loaded.zoneStats);
+    ++generation;
+    rebuildBoards();
+    // The sketches described the old counts, refill them from the loaded ones.
+    zoneSketch.clear();
+    slotSketch.clear();
+    sketchCounts(*this);
+    return true;
+}
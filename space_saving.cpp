@@ -0,0 +1,149 @@
+// Space-Saving summary, see space_saving.h.
+
+#include "space_saving.h"
+using namespace std;
+
+SpaceSaving::SpaceSaving(size_t capacity) : cap(capacity)
+{
+    entries.reserve(cap);
+    heap.reserve(cap);
+    heapPos.reserve(cap);
+    index.reserve(cap);
+}
+
+SpaceSaving::SpaceSaving(const SpaceSaving &other)
+    : cap(other.cap), heap(other.heap), heapPos(other.heapPos)
+{
+    entries.reserve(cap);
+    entries = other.entries;
+    rebuildIndex();
+}
+
+SpaceSaving &SpaceSaving::operator=(const SpaceSaving &other)
+{
+    if (this != &other)
+    {
+        cap = other.cap;
+        entries.clear();
+        entries.reserve(cap);
+        entries = other.entries;
+        heap = other.heap;
+        heapPos = other.heapPos;
+        rebuildIndex();
+    }
+    return *this;
+}
+
+void SpaceSaving::rebuildIndex()
+{
+    index.clear();
+    index.reserve(cap);
+    for (uint32_t i = 0; i < entries.size(); ++i)
+        index.emplace(string_view(entries[i].key), i);
+}
+
+void SpaceSaving::clear()
+{
+    entries.clear();
+    heap.clear();
+    heapPos.clear();
+    index.clear();
+}
+
+void SpaceSaving::add(std::string_view key, long long weight, long long error)
+{
+    if (cap == 0 || weight <= 0)
+        return;
+
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+        Entry &e = entries[it->second];
+        e.count += weight;
+        e.error += error;
+        siftDown(heapPos[it->second]);
+        return;
+    }
+
+    if (entries.size() < cap)
+    {
+        // A moved-from summary has lost its buffer; take one before pointing the index into it.
+        if (entries.capacity() < cap)
+        {
+            entries.reserve(cap);
+            rebuildIndex();
+        }
+        uint32_t id = static_cast<uint32_t>(entries.size());
+        entries.push_back({string(key), weight, error});
+        index.emplace(string_view(entries.back().key), id);
+        heap.push_back(id);
+        heapPos.push_back(static_cast<uint32_t>(heap.size() - 1));
+        siftUp(heap.size() - 1);
+        return;
+    }
+
+    // Full: the smallest counter gives its slot to the new key. Whatever it had counted may have
+    // been this key all along, so that count becomes the new key's error.
+    uint32_t id = heap.front();
+    Entry &e = entries[id];
+    // The index node is re-keyed instead of freed and allocated again.
+    auto node = index.extract(string_view(e.key));
+    e.key.assign(key.data(), key.size()); // reuses the old key's buffer when it fits
+    e.error = e.count + error;
+    e.count += weight;
+    node.key() = string_view(e.key);
+    index.insert(std::move(node));
+    siftDown(0);
+}
+
+const SpaceSaving::Entry *SpaceSaving::find(std::string_view key) const
+{
+    auto it = index.find(key);
+    return it == index.end() ? nullptr : &entries[it->second];
+}
+
+long long SpaceSaving::untrackedBound() const
+{
+    return entries.size() < cap || heap.empty() ? 0 : entries[heap.front()].count;
+}
+
+void SpaceSaving::placeAt(size_t i, uint32_t entry)
+{
+    heap[i] = entry;
+    heapPos[entry] = static_cast<uint32_t>(i);
+}
+
+// Counts only grow, so a changed entry can only have to move away from the front.
+void SpaceSaving::siftDown(size_t i)
+{
+    uint32_t moving = heap[i];
+    long long count = entries[moving].count;
+    for (;;)
+    {
+        size_t child = 2 * i + 1;
+        if (child >= heap.size())
+            break;
+        if (child + 1 < heap.size() && entries[heap[child + 1]].count < entries[heap[child]].count)
+            ++child;
+        if (entries[heap[child]].count >= count)
+            break;
+        placeAt(i, heap[child]);
+        i = child;
+    }
+    placeAt(i, moving);
+}
+
+void SpaceSaving::siftUp(size_t i)
+{
+    uint32_t moving = heap[i];
+    long long count = entries[moving].count;
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (entries[heap[parent]].count <= count)
+            break;
+        placeAt(i, heap[parent]);
+        i = parent;
+    }
+    placeAt(i, moving);
+}
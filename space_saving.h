@@ -0,0 +1,62 @@
+// Space-Saving heavy-hitter summary (Metwally et al.), used by the approximate counting mode.
+// It tracks at most `capacity` keys no matter how many distinct keys the stream has. A key that is
+// not tracked yet takes over the slot of the smallest counter and inherits its count as error,
+// so for every tracked key: count - error <= true count <= count.
+// With N total weight, every key whose true count is above N / capacity is guaranteed to be tracked.
+
+#pragma once
+#include "seeded_hash.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class SpaceSaving
+{
+public:
+    struct Entry
+    {
+        std::string key;
+        long long count = 0; // upper bound of the key's true count
+        long long error = 0; // how much of count may belong to keys it replaced
+    };
+
+    explicit SpaceSaving(size_t capacity = 0);
+    // The index points into entries, so a copy has to build its own.
+    SpaceSaving(const SpaceSaving &other);
+    SpaceSaving &operator=(const SpaceSaving &other);
+    SpaceSaving(SpaceSaving &&) = default;
+    SpaceSaving &operator=(SpaceSaving &&) = default;
+
+    // Adds weight occurrences of key. error is the uncertainty the weight already carries
+    // (non-zero when folding in another summary's entry).
+    void add(std::string_view key, long long weight = 1, long long error = 0);
+
+    // Tracked entry, or nullptr.
+    const Entry *find(std::string_view key) const;
+
+    // Upper bound on the true count of any key that is not tracked: the smallest counter once
+    // the summary is full, 0 before that (nothing has been dropped yet).
+    long long untrackedBound() const;
+
+    size_t capacity() const { return cap; }
+    size_t size() const { return entries.size(); }
+    // Entries in no particular order.
+    const std::vector<Entry> &all() const { return entries; }
+    void clear();
+
+private:
+    void siftDown(size_t i);
+    void siftUp(size_t i);
+    void placeAt(size_t i, uint32_t entry);
+    void rebuildIndex();
+
+    size_t cap;
+    // Never grows past cap, so it never reallocates and the index can point at its keys.
+    std::vector<Entry> entries;
+    // Min-heap of entry indices by count; the front is the counter an untracked key replaces.
+    std::vector<uint32_t> heap;
+    std::vector<uint32_t> heapPos; // entry -> position in heap
+    std::unordered_map<std::string_view, uint32_t, SeededStringHash> index; // keys come from the input
+};
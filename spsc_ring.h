@@ -0,0 +1,53 @@
+// Bounded single-producer / single-consumer ring buffer, used to hand work between the stages of
+// IngestMode::Pipelined. Exactly one thread may push and exactly one other thread may pop.
+// No locks: the producer only writes tail, the consumer only writes head, and each publishes its
+// index with a release store that the other side reads with an acquire load.
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+template <class T>
+class SpscRing
+{
+public:
+    // Capacity is rounded up to a power of two so an index wraps with a mask.
+    explicit SpscRing(size_t capacity)
+    {
+        size_t n = 2;
+        while (n < capacity)
+            n *= 2;
+        items.resize(n);
+        mask = n - 1;
+    }
+
+    // False if the ring is full.
+    bool tryPush(const T &item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) > mask)
+            return false;
+        items[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // False if the ring is empty.
+    bool tryPop(T &out)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        out = items[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> items;
+    size_t mask = 0;
+    // On their own cache lines, so the producer and the consumer don't keep stealing one line.
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
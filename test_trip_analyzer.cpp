@@ -1,9 +1,16 @@
 #include "analyzer.h"
 #include "catch_amalgamated.hpp"
+// Test hook: every operator new in this binary is counted, so a test can check that a stretch of
+// code made no heap allocations at all.
+#include "alloc_counter.h"
 
 #include <fstream>
 #include <string>
 #include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <thread>
 #include <cstdio>   // std::remove
 
 // ------------------- helpers -------------------
@@ -13,6 +20,12 @@ static void writeFile(const std::string& path, const std::vector<std::string>& l
     for (const auto& ln : lines) out << ln << "\n";
 }
 
+// One data row: trip id, pickup zone and hour, the other columns fixed.
+static std::string tripRow(long long id, const std::string& zone, int hour, const char* eol = "\n") {
+    return std::to_string(id) + "," + zone + ",ZX,2024-01-01 " + (hour < 10 ? "0" : "") + std::to_string(hour) +
+           ":00,1,1" + eol;
+}
+
 static bool hasZone(const std::vector<ZoneCount>& v, const std::string& zone, long long count) {
     for (const auto& z : v) if (z.zone == zone && z.count == count) return true;
     return false;
@@ -23,6 +36,20 @@ static bool hasSlot(const std::vector<SlotCount>& v, const std::string& zone, in
     return false;
 }
 
+static bool sameZones(const std::vector<ZoneCount>& a, const std::vector<ZoneCount>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (a[i].zone != b[i].zone || a[i].count != b[i].count) return false;
+    return true;
+}
+
+static bool sameSlots(const std::vector<SlotCount>& a, const std::vector<SlotCount>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (a[i].zone != b[i].zone || a[i].hour != b[i].hour || a[i].count != b[i].count) return false;
+    return true;
+}
+
 static const char* HDR = "TripID,PickupZoneID,DropoffZoneID,PickupDateTime,DistanceKm,FareAmount";
 
 // ------------------- A: ingestion robustness -------------------
@@ -281,3 +308,742 @@ TEST_CASE("C3", "[C3]") {
 
     std::remove(path.c_str());
 }
+
+// ------------------- D: ingest modes / extended API -------------------
+
+TEST_CASE("D1", "[D1]") {
+    const std::string path = "d1.csv";
+
+    // CRLF endings, blank lines, malformed rows and no trailing newline
+    // must give the same answer whether the file is streamed or mapped.
+    {
+        std::ofstream out(path, std::ios::binary);
+        REQUIRE(out.is_open());
+        out << HDR << "\r\n"
+            << "1,ZONE_A,ZX,2024-01-01 09:15,1,1\r\n"
+            << "\r\n"
+            << "2,,ZX,2024-01-01 09:15,1,1\r\n"
+            << "3,ZONE_B,ZX,NOT_A_DATE,1,1\n"
+            << "4,ZONE_B,ZX,2024-01-01 23:59,1,1\r\n"
+            << "5,ZONE_A,ZX,2024-01-01 09:00,1,1";
+    }
+
+    TripAnalyzer streamed;
+    streamed.setIngestMode(IngestMode::Stream);
+    streamed.ingestFile(path);
+
+    TripAnalyzer mapped;
+    mapped.setIngestMode(IngestMode::Mapped);
+    mapped.ingestFile(path);
+
+    auto zm = mapped.topZones(10);
+    REQUIRE(zm.size() == 2);
+    REQUIRE(sameZones(zm, streamed.topZones(10)));
+    REQUIRE(sameSlots(mapped.topBusySlots(10), streamed.topBusySlots(10)));
+    REQUIRE(hasZone(zm, "ZONE_A", 2));
+    REQUIRE(hasSlot(mapped.topBusySlots(10), "ZONE_B", 23, 1));
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("D2", "[D2]") {
+    const std::string path = "d2.csv";
+
+    // Big enough (~8 MB) that Parallel really splits it into several chunks.
+    {
+        std::ofstream out(path, std::ios::binary);
+        REQUIRE(out.is_open());
+        out << HDR << "\r\n";
+        for (int i = 0; i < 200000; ++i) {
+            out << tripRow(i + 1, "ZONE_" + std::to_string(i % 997), (i * 7) % 24, i % 3 == 0 ? "\r\n" : "\n");
+            if (i % 1000 == 0) out << "bad,row\n\n";
+        }
+    }
+
+    TripAnalyzer serial;
+    serial.setIngestMode(IngestMode::Stream);
+    serial.ingestFile(path);
+
+    TripAnalyzer parallel;
+    parallel.setIngestMode(IngestMode::Parallel);
+    parallel.setThreadCount(4);
+    parallel.ingestFile(path);
+
+    REQUIRE(serial.topZones(2000).size() == 997);
+    REQUIRE(sameZones(parallel.topZones(2000), serial.topZones(2000)));
+    REQUIRE(sameSlots(parallel.topBusySlots(100000), serial.topBusySlots(100000)));
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("D3", "[D3]") {
+    const std::string path = "d3.csv";
+
+    // The A2 dirty rows plus rows long enough to span several 16/32-byte SIMD blocks.
+    writeFile(path, {
+        HDR,
+        "1,ZONE_A,ZONE_X,2024-01-01 09:15,1.2,10.0",
+        "2,,ZONE_X,2024-01-01 09:15,1.2,10.0",
+        "3,ZONE_A,ZONE_X,,1.2,10.0",
+        "4,ZONE_A,ZONE_X,2024-01-01 10:00",
+        "5,ZONE_B,ZONE_Y,NOT_A_DATE,2.0,12.5",
+        "6,ZONE_B,ZONE_Y,2024-01-01 23:59,2.0,12.5",
+        "7,  A_VERY_LONG_PICKUP_ZONE_IDENTIFIER_0123456789  ,ZONE_Y,2024-01-01 07:00,2.0,12.5,,,,",
+        "8,ZONE_C,A_VERY_LONG_DROPOFF_ZONE_IDENTIFIER_0123456789,2024-01-01   05:30,2.0",
+        "9,ZONE_C,ZONE_Y,2024-01-01 24:00,2.0,12.5"
+    });
+
+    for (RowScanner scanner : {RowScanner::Scalar, RowScanner::SSE2, RowScanner::AVX2, RowScanner::Auto}) {
+        TripAnalyzer ta;
+        ta.setRowScanner(scanner);
+        ta.ingestFile(path);
+
+        auto topZ = ta.topZones(10);
+        auto topS = ta.topBusySlots(10);
+        REQUIRE(topZ.size() == 3);
+        REQUIRE(hasZone(topZ, "ZONE_A", 1));
+        REQUIRE(hasZone(topZ, "ZONE_B", 1));
+        REQUIRE(hasZone(topZ, "A_VERY_LONG_PICKUP_ZONE_IDENTIFIER_0123456789", 1));
+        REQUIRE(hasSlot(topS, "ZONE_A", 9, 1));
+        REQUIRE(hasSlot(topS, "ZONE_B", 23, 1));
+        REQUIRE(hasSlot(topS, "A_VERY_LONG_PICKUP_ZONE_IDENTIFIER_0123456789", 7, 1));
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("D4", "[D4]") {
+    const std::string path = "d4.csv";
+
+    // Fixed "YYYY-MM-DD HH:MM" rows take the fast path, everything else the general parser.
+    writeFile(path, {
+        HDR,
+        "1,ZONE_A,ZX,2024-01-01 07:05,1,1",     // fixed layout
+        "2,ZONE_A,ZX,2024-01-01 7:05,1,1",      // one-digit hour
+        "3,ZONE_A,ZX,2024-01-01  07:05,1,1",    // two spaces
+        "4,ZONE_A,ZX,2024/01/01 07:05,1,1",     // other date separators
+        "5,ZONE_A,ZX,2024-01-01 24:00,1,1",     // fixed layout, hour out of range
+        "6,ZONE_A,ZX,2024-01-01 23:59:59,1,1",  // seconds after the fixed part
+        "7,ZONE_A,ZX,2024-01-01T07:05,1,1"      // no space at all
+    });
+
+    TripAnalyzer ta;
+    ta.ingestFile(path);
+
+    auto topS = ta.topBusySlots(10);
+    REQUIRE(topS.size() == 2);
+    REQUIRE(hasSlot(topS, "ZONE_A", 7, 4));
+    REQUIRE(hasSlot(topS, "ZONE_A", 23, 1));
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("D5", "[D5]") {
+    // Same rows as a file, handed over straight from memory.
+    const std::string data =
+        std::string(HDR) + "\r\n"
+        "1,ZONE_A,ZX,2024-01-01 09:15,1,1\r\n"
+        "2,,ZX,2024-01-01 09:15,1,1\n"
+        "3,ZONE_B,ZX,2024-01-01 23:59,1,1\n"
+        "4,ZONE_A,ZX,2024-01-01 09:45,1,1";
+
+    TripAnalyzer ta;
+    ta.ingestBuffer(data);
+    REQUIRE(hasZone(ta.topZones(10), "ZONE_A", 2));
+    REQUIRE(hasSlot(ta.topBusySlots(10), "ZONE_B", 23, 1));
+
+    // Buffers add up like files do.
+    ta.ingestBuffer("5,ZONE_B,ZX,2024-01-01 23:00,1,1\n6,ZONE_B,ZX,2024-01-01 22:00,1,1\n", false);
+    REQUIRE(hasZone(ta.topZones(10), "ZONE_B", 3));
+    REQUIRE(hasSlot(ta.topBusySlots(10), "ZONE_B", 23, 2));
+
+    // With header detection on, a first line that doesn't start with a digit is skipped;
+    // with it off the first line is an ordinary row.
+    const std::string noHeader = "ROW,ZONE_C,ZX,2024-01-01 01:00,1,1\n7,ZONE_C,ZX,2024-01-01 01:00,1,1\n";
+    TripAnalyzer sniffed;
+    sniffed.ingestBuffer(noHeader, true);
+    REQUIRE(hasZone(sniffed.topZones(10), "ZONE_C", 1));
+    TripAnalyzer raw;
+    raw.ingestBuffer(noHeader, false);
+    REQUIRE(hasZone(raw.topZones(10), "ZONE_C", 2));
+
+    TripAnalyzer empty;
+    empty.ingestBuffer({});
+    REQUIRE(empty.topZones(10).empty());
+}
+
+TEST_CASE("D6", "[D6]") {
+    std::string data = std::string(HDR) + "\r\n";
+    for (int i = 0; i < 3000; ++i) {
+        data += tripRow(i + 1, "ZONE_" + std::to_string(i % 37), i % 24, i % 5 == 0 ? "\r\n" : "\n");
+    }
+    data += "3001,ZONE_LAST,ZX,2024-01-01 05:00,1,1"; // no trailing newline
+
+    TripAnalyzer whole;
+    whole.ingestBuffer(data);
+
+    // Every chunk size cuts rows (and the header) in different places, the totals must not move.
+    for (size_t chunk : {size_t(1), size_t(7), size_t(64), size_t(65536)}) {
+        TripAnalyzer streamed;
+        streamed.beginStream();
+        for (size_t pos = 0; pos < data.size(); pos += chunk)
+            streamed.feed(std::string_view(data).substr(pos, chunk));
+        streamed.endStream();
+
+        REQUIRE(sameZones(streamed.topZones(100), whole.topZones(100)));
+        REQUIRE(sameSlots(streamed.topBusySlots(1000), whole.topBusySlots(1000)));
+        REQUIRE(hasZone(streamed.topZones(100), "ZONE_LAST", 1));
+    }
+
+    // A second session sniffs its own header again.
+    whole.beginStream();
+    whole.feed("TripID,PickupZoneID\n1,ZONE_LAST,ZX,2024-01-01 05:10,1,1\n");
+    whole.endStream();
+    REQUIRE(hasZone(whole.topZones(100), "ZONE_LAST", 2));
+}
+
+TEST_CASE("D7", "[D7]") {
+    const std::string snap = "d7.snap";
+
+    std::string data;
+    for (int i = 0; i < 5000; ++i)
+        data += tripRow(i + 1, "ZONE_" + std::to_string((i * 31) % 401), i % 24);
+    TripAnalyzer original;
+    original.ingestBuffer(data, false);
+    REQUIRE(original.saveSnapshot(snap));
+
+    TripAnalyzer restored;
+    REQUIRE(restored.loadSnapshot(snap));
+    REQUIRE(sameZones(restored.topZones(1000), original.topZones(1000)));
+    REQUIRE(sameSlots(restored.topBusySlots(100000), original.topBusySlots(100000)));
+
+    // A restored analyzer keeps counting on top of the snapshot.
+    restored.ingestBuffer("1,ZONE_0,ZX,2024-01-01 00:10,1,1\n", false);
+    REQUIRE(restored.topZones(1000).size() == original.topZones(1000).size());
+
+    // Flip one byte: the checksum must reject the file and leave the analyzer alone.
+    {
+        std::fstream f(snap, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(40);
+        f.put('#');
+    }
+    TripAnalyzer untouched;
+    untouched.ingestBuffer("1,ZONE_X,ZX,2024-01-01 03:00,1,1\n", false);
+    REQUIRE_FALSE(untouched.loadSnapshot(snap));
+    REQUIRE_FALSE(untouched.loadSnapshot("missing_snapshot_hopefully_123.snap"));
+    REQUIRE(hasZone(untouched.topZones(10), "ZONE_X", 1));
+    REQUIRE(untouched.topZones(10).size() == 1);
+
+    std::remove(snap.c_str());
+}
+
+TEST_CASE("D8", "[D8]") {
+    std::string dayOne, dayTwo;
+    for (int i = 0; i < 4000; ++i)
+        (i % 3 == 0 ? dayOne : dayTwo) += tripRow(i + 1, "ZONE_" + std::to_string((i * 13) % 257), i % 24);
+
+    TripAnalyzer single;
+    single.ingestBuffer(dayOne, false);
+    single.ingestBuffer(dayTwo, false);
+
+    TripAnalyzer a, b;
+    a.ingestBuffer(dayOne, false);
+    b.ingestBuffer(dayTwo, false);
+
+    // Copying merge leaves the source as it was.
+    TripAnalyzer copied;
+    copied.merge(a);
+    copied.merge(b);
+    REQUIRE(sameZones(copied.topZones(1000), single.topZones(1000)));
+    REQUIRE(sameSlots(copied.topBusySlots(100000), single.topBusySlots(100000)));
+    REQUIRE(!b.topZones(1).empty());
+
+    // Moving merge gives the same answer and empties the source.
+    a.merge(std::move(b));
+    REQUIRE(sameZones(a.topZones(1000), single.topZones(1000)));
+    REQUIRE(sameSlots(a.topBusySlots(100000), single.topBusySlots(100000)));
+    REQUIRE(b.topZones(10).empty());
+
+    // Merging into an empty analyzer is just taking over the counts.
+    TripAnalyzer empty;
+    empty.merge(std::move(a));
+    REQUIRE(sameZones(empty.topZones(1000), single.topZones(1000)));
+
+    // A moved-from dictionary or analyzer starts over in storage of its own: new zones in the source
+    // must not land in the name blocks it handed to the destination.
+    ZoneDict src;
+    src.intern("Z_OLD");
+    ZoneDict dst(std::move(src));
+    src.intern("Z_SRC");
+    dst.intern("Z_DST");
+    ZoneDict assigned;
+    assigned.intern("Z_PREV");
+    assigned = std::move(dst);
+    dst.intern("Z_AGAIN");
+    assigned.intern("Z_LAST");
+    REQUIRE(src.size() == 1);
+    REQUIRE(src.name(0) == "Z_SRC");
+    REQUIRE(dst.size() == 1);
+    REQUIRE(dst.name(0) == "Z_AGAIN");
+    REQUIRE(assigned.size() == 3);
+    REQUIRE(assigned.name(0) == "Z_OLD");
+    REQUIRE(assigned.name(1) == "Z_DST");
+    REQUIRE(assigned.name(2) == "Z_LAST");
+    REQUIRE(assigned.find("Z_PREV") == ZoneDict::npos);
+
+    TripAnalyzer first;
+    first.ingestBuffer("1,M_OLD,ZX,2024-01-01 05:00,1,1\n", false);
+    TripAnalyzer second(std::move(first));
+    first.ingestBuffer("2,M_SRC,ZX,2024-01-01 06:00,1,1\n", false);
+    second.ingestBuffer("3,M_DST,ZX,2024-01-01 07:00,1,1\n", false);
+    TripAnalyzer third;
+    third = std::move(second);
+    second.ingestBuffer("4,M_AGAIN,ZX,2024-01-01 08:00,1,1\n", false);
+    third.ingestBuffer("5,M_DST,ZX,2024-01-01 09:00,1,1\n", false);
+    REQUIRE(sameZones(first.topZones(10), {{"M_SRC", 1}}));
+    REQUIRE(sameZones(second.topZones(10), {{"M_AGAIN", 1}}));
+    REQUIRE(sameZones(third.topZones(10), {{"M_DST", 2}, {"M_OLD", 1}}));
+    REQUIRE(third.countForSlot("M_OLD", 5) == 1);
+}
+
+TEST_CASE("D9", "[D9]") {
+    // Batches whose busy zones shift, so leaderboard members get overtaken and evicted.
+    auto batch = [](int b) {
+        std::string data;
+        for (int i = 0; i < 3000; ++i) {
+            int zone = (i % 5 == 0) ? (b * 7 + i % 11) % 40 : (i * 31 + b) % 97;
+            data += tripRow(i, "Z" + std::to_string(zone), (i * 7 + b) % 24);
+        }
+        return data;
+    };
+
+    TripAnalyzer plain, incremental;
+    incremental.setIncrementalTopK(10);
+    for (int b = 0; b < 6; ++b) {
+        // Cached results must not outlive an ingest.
+        std::vector<ZoneCount> before = plain.topZones(20);
+        plain.ingestBuffer(batch(b), false);
+        incremental.ingestBuffer(batch(b), false);
+        if (b > 0) REQUIRE(!sameZones(before, plain.topZones(20)));
+
+        TripAnalyzer fresh;
+        for (int i = 0; i <= b; ++i) fresh.ingestBuffer(batch(i), false);
+        for (int k : {1, 5, 10, 20}) {
+            REQUIRE(sameZones(plain.topZones(k), fresh.topZones(k)));
+            REQUIRE(sameZones(incremental.topZones(k), fresh.topZones(k)));
+            REQUIRE(sameSlots(plain.topBusySlots(k), fresh.topBusySlots(k)));
+            REQUIRE(sameSlots(incremental.topBusySlots(k), fresh.topBusySlots(k)));
+        }
+    }
+
+    // Bulk changes rebuild the leaderboards.
+    TripAnalyzer other;
+    other.ingestBuffer(batch(9), false);
+    plain.merge(other);
+    incremental.merge(std::move(other));
+    REQUIRE(sameZones(incremental.topZones(10), plain.topZones(10)));
+    REQUIRE(sameSlots(incremental.topBusySlots(10), plain.topBusySlots(10)));
+}
+
+TEST_CASE("D10", "[D10]") {
+    // A few heavy zones buried in a long tail of zones that show up once each.
+    std::string data;
+    std::map<std::string, long long> truth;
+    for (int i = 0; i < 30000; ++i) {
+        std::string zone = (i % 4 == 0) ? "HOT_" + std::to_string(i % 3) : "TAIL_" + std::to_string(i);
+        if (i % 10 == 1) zone = "WARM";
+        truth[zone]++;
+        data += tripRow(i, zone, i % 3);
+    }
+
+    TripAnalyzer exact;
+    exact.ingestBuffer(data, false);
+    for (const auto& z : exact.topZonesWithError(5)) REQUIRE(z.error == 0);
+
+    TripAnalyzer approx;
+    approx.setApproximate(64);
+    approx.ingestBuffer(data, false);
+
+    // Every zone above 1/64 of the trips is reported, and its true count is inside the bounds.
+    std::vector<ApproxZoneCount> top = approx.topZonesWithError(64);
+    REQUIRE(top.size() == 64);
+    REQUIRE(top[0].zone == "WARM");
+    for (int h = 0; h < 3; ++h) {
+        auto it = std::find_if(top.begin(), top.end(), [&](const ApproxZoneCount& z) { return z.zone == "HOT_" + std::to_string(h); });
+        REQUIRE(it != top.end());
+    }
+    for (const auto& z : top) {
+        long long real = truth.count(z.zone) ? truth[z.zone] : 0;
+        REQUIRE(z.count - z.error <= real);
+        REQUIRE(real <= z.count);
+    }
+    REQUIRE(approx.topZones(4).size() == 4);
+    REQUIRE(approx.topBusySlotsWithError(3).size() == 3);
+    REQUIRE(!approx.saveSnapshot("approx_snapshot.bin"));
+
+    // With room for every key nothing is ever evicted, so the summary is exact.
+    std::string small = data.substr(0, data.find('\n', 2000) + 1);
+    size_t half = small.find('\n', 1000) + 1;
+    TripAnalyzer smallExact, roomy;
+    smallExact.ingestBuffer(small, false);
+    roomy.ingestBuffer(small.substr(0, half), false); // exact counts so far get folded in
+    roomy.setApproximate(100000);
+    roomy.ingestBuffer(small.substr(half), false);
+    REQUIRE(sameZones(roomy.topZones(1000), smallExact.topZones(1000)));
+    REQUIRE(sameSlots(roomy.topBusySlots(1000), smallExact.topBusySlots(1000)));
+
+    // Merging an approximate analyzer makes the target approximate too.
+    TripAnalyzer target;
+    target.merge(roomy);
+    REQUIRE(sameZones(target.topZones(1000), smallExact.topZones(1000)));
+    REQUIRE(target.topZonesWithError(1)[0].error == 0);
+}
+
+TEST_CASE("D11", "[D11]") {
+    std::string data;
+    for (int i = 0; i < 20000; ++i) {
+        int zone = (i % 3 == 0) ? 7 : (i * 37) % 5000;
+        data += tripRow(i, "Z" + std::to_string(zone), (i * 11) % 24);
+    }
+
+    TripAnalyzer exact;
+    exact.ingestBuffer(data, false);
+    // Without a sketch the point queries are exact.
+    REQUIRE(exact.estimateZone("Z7") == exact.topZones(1)[0].count);
+    REQUIRE(exact.estimateZone("NOPE") == 0);
+    REQUIRE(exact.sketchErrorBound() == 0);
+
+    TripAnalyzer both, sketchOnly;
+    both.setSketch(4096, 5);
+    sketchOnly.setSketch(4096, 5, false);
+    both.ingestBuffer(data, false);
+    sketchOnly.ingestBuffer(data, false);
+
+    // The exact side is untouched, the sketch only ever overcounts.
+    REQUIRE(sameZones(both.topZones(100), exact.topZones(100)));
+    REQUIRE(sketchOnly.topZones(10).empty());
+    REQUIRE(both.sketchErrorBound() > 0);
+    int under = 0, differ = 0;
+    for (const auto& z : exact.topZones(6000)) {
+        under += both.estimateZone(z.zone) < z.count;
+        differ += sketchOnly.estimateZone(z.zone) != both.estimateZone(z.zone);
+    }
+    for (const auto& s : exact.topBusySlots(20000))
+        under += both.estimateSlot(s.zone, s.hour) < s.count;
+    REQUIRE(under == 0);
+    REQUIRE(differ == 0);
+    REQUIRE(both.estimateZone("Z7") - exact.estimateZone("Z7") <= both.sketchErrorBound());
+
+    // Turned on late, the sketch starts from the exact counts.
+    TripAnalyzer late;
+    late.ingestBuffer(data, false);
+    late.setSketch(4096, 5);
+    REQUIRE(late.estimateZone("Z7") >= exact.estimateZone("Z7"));
+    REQUIRE(late.estimateSlot("Z7", 0) >= exact.estimateSlot("Z7", 0));
+    REQUIRE(late.estimateSlot("Z7", 24) == 0);
+    REQUIRE(!sketchOnly.saveSnapshot("sketch_snapshot.bin"));
+
+    // A second setSketch on a sketch-only analyzer with data would throw the counts away, so it is refused.
+    const long long z7 = sketchOnly.estimateZone("Z7");
+    REQUIRE(!sketchOnly.setSketch(8192, 5, false));
+    REQUIRE(!sketchOnly.setSketch(4096, 5, true));
+    REQUIRE(!sketchOnly.setSketch(0, 0));
+    REQUIRE(sketchOnly.setSketch(4096, 5, false));
+    REQUIRE(sketchOnly.estimateZone("Z7") == z7);
+    REQUIRE(sketchOnly.sketchErrorBound() == both.sketchErrorBound());
+    // Before any rows it can still be reshaped freely.
+    TripAnalyzer fresh;
+    REQUIRE(fresh.setSketch(4096, 5, false));
+    REQUIRE(fresh.setSketch(8192, 4, false));
+
+    // Merging a sketch-only analyzer: its rows are only in the sketch, so the exact side switches to it.
+    const long long twice = 2 * exact.estimateZone("Z7");
+    TripAnalyzer target;
+    target.ingestBuffer(data, false);
+    REQUIRE(target.merge(sketchOnly));
+    REQUIRE(target.topZones(10).empty());
+    REQUIRE(target.estimateZone("Z7") >= twice);
+    REQUIRE(target.estimateZone("Z7") - twice <= target.sketchErrorBound());
+    REQUIRE(target.sketchErrorBound() > sketchOnly.sketchErrorBound());
+    // A sketch of the same shape already holds every row, the two sketches just add up.
+    REQUIRE(both.merge(std::move(sketchOnly)));
+    REQUIRE(both.topZones(10).empty());
+    REQUIRE(both.estimateZone("Z7") == 2 * z7);
+    // Nothing to switch to: another shape that can't be rebuilt, or summaries. Refused, nothing changes.
+    TripAnalyzer narrow, approx, second;
+    narrow.setSketch(1024, 4, false);
+    narrow.ingestBuffer(data, false);
+    approx.setApproximate(100);
+    approx.ingestBuffer(data, false);
+    second.setSketch(4096, 5, false);
+    second.ingestBuffer(data, false);
+    const long long narrowZ7 = narrow.estimateZone("Z7");
+    const std::vector<ZoneCount> approxTop = approx.topZones(10);
+    REQUIRE(!narrow.merge(second));
+    REQUIRE(narrow.estimateZone("Z7") == narrowZ7);
+    REQUIRE(!approx.merge(std::move(second)));
+    REQUIRE(sameZones(approx.topZones(10), approxTop));
+    REQUIRE(second.estimateZone("Z7") == z7);
+}
+
+TEST_CASE("D12", "[D12]") {
+    std::string data;
+    for (int i = 0; i < 5000; ++i) {
+        // Long names too, so lookups past the inline key prefix get checked.
+        std::string zone = (i % 2 ? "Z" : "A_RATHER_LONG_ZONE_NAME_") + std::to_string((i * 17) % 300);
+        data += tripRow(i, zone, (i * 5) % 24);
+    }
+    TripAnalyzer ta;
+    ta.ingestBuffer(data, false);
+
+    std::vector<ZoneCount> zs = ta.topZones(1000);
+    std::vector<SlotCount> ss = ta.topBusySlots(100000);
+    std::vector<std::string_view> names;
+    std::vector<std::pair<std::string_view, int>> slots;
+    int wrong = 0;
+    for (const auto& z : zs) {
+        wrong += ta.countForZone(z.zone) != z.count;
+        names.push_back(z.zone);
+    }
+    for (const auto& s : ss) {
+        wrong += ta.countForSlot(s.zone, s.hour) != s.count;
+        slots.push_back({s.zone, s.hour});
+    }
+    REQUIRE(wrong == 0);
+
+    // Unknown keys and bad hours are 0, in the batches too.
+    REQUIRE(ta.countForZone("NOPE") == 0);
+    REQUIRE(ta.countForSlot(zs[0].zone, 24) == 0);
+    REQUIRE(ta.countForSlot(zs[0].zone, -1) == 0);
+    names.push_back("NOPE");
+    slots.push_back({zs[0].zone, 99});
+
+    std::vector<long long> zoneCounts = ta.countsForZones(names);
+    std::vector<long long> slotCounts = ta.countsForSlots(slots);
+    REQUIRE(zoneCounts.size() == names.size());
+    REQUIRE(slotCounts.size() == slots.size());
+    for (size_t i = 0; i < zs.size(); ++i) wrong += zoneCounts[i] != zs[i].count;
+    for (size_t i = 0; i < ss.size(); ++i) wrong += slotCounts[i] != ss[i].count;
+    REQUIRE(wrong == 0);
+    REQUIRE(zoneCounts.back() == 0);
+    REQUIRE(slotCounts.back() == 0);
+    REQUIRE(TripAnalyzer().countsForZones(names) == std::vector<long long>(names.size(), 0));
+}
+
+TEST_CASE("D13", "[D13]") {
+    std::string data;
+    for (int i = 0; i < 20000; ++i) {
+        std::string zone = (i % 4 == 0) ? "HOT" : "Z" + std::to_string((i * 37) % 3000);
+        data += tripRow(i, zone, (i * 7) % 24, "\r\n");
+    }
+
+    // Once every zone has been seen, rows only bump counters: no allocation in any of these modes.
+    TripAnalyzer plain, board, approx;
+    board.setIncrementalTopK(50);
+    approx.setApproximate(500);
+    auto ingestAll = [&data](TripAnalyzer& ta) {
+        ta.ingestBuffer(data, false);
+        ta.beginStream(false);
+        for (size_t at = 0; at < data.size(); at += 4096)
+            ta.feed(std::string_view(data).substr(at, 4096));
+        ta.endStream();
+    };
+    for (TripAnalyzer* ta : {&plain, &board, &approx}) {
+        ingestAll(*ta); // warm-up
+        size_t before = allocationCount();
+        ingestAll(*ta);
+        size_t allocs = allocationCount() - before;
+        REQUIRE(allocs == 0);
+    }
+    REQUIRE(hasZone(plain.topZones(1), "HOT", 4 * 5000));
+    REQUIRE(sameZones(board.topZones(50), plain.topZones(50)));
+    REQUIRE(sameSlots(board.topBusySlots(50), plain.topBusySlots(50)));
+}
+
+TEST_CASE("D14", "[D14]") {
+    const std::string path = "d14.csv";
+
+    // Several pipeline blocks, rows cut at every block edge, CRLF, junk, a line longer than a whole
+    // block and no trailing newline.
+    {
+        std::ofstream out(path, std::ios::binary);
+        REQUIRE(out.is_open());
+        out << HDR << "\r\n";
+        for (int i = 0; i < 150000; ++i) {
+            out << tripRow(i + 1, "ZONE_" + std::to_string(i % 1499), (i * 5) % 24, i % 2 == 0 ? "\r\n" : "\n");
+            if (i % 997 == 0) out << "bad,row\n\n";
+            if (i == 70000) out << std::string(3 << 20, 'x') << "\n";
+        }
+        out << "150001,ZONE_LAST,ZX,2024-01-01 06:00,1,1";
+    }
+
+    TripAnalyzer serial;
+    serial.setIngestMode(IngestMode::Stream);
+    serial.ingestFile(path);
+
+    for (RowScanner scanner : {RowScanner::Scalar, RowScanner::Auto}) {
+        TripAnalyzer piped;
+        piped.setIngestMode(IngestMode::Pipelined);
+        piped.setRowScanner(scanner);
+        piped.ingestFile(path);
+        REQUIRE(sameZones(piped.topZones(2000), serial.topZones(2000)));
+        REQUIRE(sameSlots(piped.topBusySlots(100000), serial.topBusySlots(100000)));
+        REQUIRE(piped.countForSlot("ZONE_LAST", 6) == 1);
+    }
+
+    // A missing file is a no-op, like in every other mode.
+    TripAnalyzer missing;
+    missing.setIngestMode(IngestMode::Pipelined);
+    missing.ingestFile("no_such_file.csv");
+    REQUIRE(missing.topZones(10).empty());
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("D15", "[D15]") {
+    // Many zones plus one hot zone, cut into slices at row boundaries.
+    std::vector<std::string> slices(8);
+    for (int i = 0; i < 80000; ++i) {
+        std::string zone = (i % 5 == 0) ? "HOT" : "Z" + std::to_string((i * 131) % 20000);
+        slices[i % 8] += tripRow(i, zone, (i * 13) % 24);
+    }
+    const std::string path = "d15.csv";
+    writeFile(path, {HDR, "1,FROM_FILE,ZX,2024-01-01 03:00,1,1", "2,HOT,ZX,2024-01-01 03:00,1,1"});
+
+    TripAnalyzer serial;
+    for (const auto& slice : slices) serial.ingestBuffer(slice, false);
+    serial.ingestFile(path);
+
+    TripAnalyzer shared;
+    shared.setSketch(2048, 4);
+    shared.beginConcurrent(16);
+    std::vector<std::thread> producers;
+    for (const auto& slice : slices)
+        producers.emplace_back([&shared, &slice]() { shared.ingestBuffer(slice, false); });
+    producers.emplace_back([&shared, &path]() { shared.ingestFile(path); });
+    for (auto& t : producers) t.join();
+    shared.endConcurrent();
+
+    REQUIRE(sameZones(shared.topZones(30000), serial.topZones(30000)));
+    REQUIRE(sameSlots(shared.topBusySlots(1000), serial.topBusySlots(1000)));
+    REQUIRE(shared.countForSlot("FROM_FILE", 3) == 1);
+    REQUIRE(shared.estimateZone("HOT") >= serial.countForZone("HOT"));
+
+    // A second session adds on top of the first.
+    shared.beginConcurrent(1);
+    shared.ingestBuffer(slices[0], false);
+    shared.endConcurrent();
+    REQUIRE(shared.countForZone("HOT") == serial.countForZone("HOT") + 2000);
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("D16", "[D16]") {
+    // Zones built so that under one seed every hash agrees in its low 12 bits.
+    const uint64_t crafted = 12345, saved = hashSeed();
+    const uint64_t mask = (1u << 12) - 1;
+    std::vector<std::string> zones;
+    const uint64_t target = seededHash("Z0", crafted) & mask;
+    for (int i = 0; zones.size() < 300; ++i) {
+        std::string name = "Z" + std::to_string(i);
+        if ((seededHash(name, crafted) & mask) == target) zones.push_back(name);
+    }
+    std::string data;
+    for (size_t i = 0; i < zones.size(); ++i)
+        for (size_t k = 0; k <= i % 3; ++k)
+            data += tripRow(1, zones[i], static_cast<int>(k));
+
+    // Even with the seed known to whoever wrote the data, a long probe chain stays correct.
+    setHashSeed(crafted);
+    {
+        TripAnalyzer a;
+        a.ingestBuffer(data, false);
+        REQUIRE(a.topZones(1000).size() == 300);
+        for (size_t i = 0; i < zones.size(); ++i) {
+            REQUIRE(a.countForZone(zones[i]) == static_cast<long long>(i % 3 + 1));
+            REQUIRE(a.countForSlot(zones[i], 0) == 1);
+        }
+    }
+
+    // Under any other seed the same names spread over the low bits.
+    setHashSeed(crafted + 1);
+    std::set<uint64_t> low;
+    for (const auto& z : zones) low.insert(seededHash(z, hashSeed()) & mask);
+    REQUIRE(low.size() > 250);
+
+    setHashSeed(saved);
+}
+
+TEST_CASE("D17", "[D17]") {
+    const std::vector<std::string> lines = {
+        HDR,
+        "1,A,ZX,2024-01-01 08:00,1,1",
+        "2,A",                         // too few commas
+        "3, ,ZX,2024-01-01 08:00,1,1", // empty zone
+        "4,B,ZX,NOT_A_DATE,1,1",       // bad datetime
+        "5,B,ZX,2024-01-01 24:30,1,1", // hour out of range
+        "",
+        "6,B,ZX,2024-01-01 9:15,1,1"};
+    const std::string path = "d17.csv";
+    writeFile(path, lines);
+    std::string data;
+    for (const auto& ln : lines) data += ln + "\n";
+
+    // Every way in agrees on what it saw, and the counts themselves never change.
+    auto check = [&](const TripAnalyzer& a) {
+        const IngestStats& s = a.ingestStats();
+        REQUIRE(a.countForZone("A") == 1);
+        REQUIRE(a.countForSlot("B", 9) == 1);
+#if TRIP_STATS
+        REQUIRE(s.bytesRead == data.size());
+        REQUIRE(s.rowsSeen == 6);
+        REQUIRE(s.rowsAccepted == 2);
+        REQUIRE(s.rejectedFewCommas == 1);
+        REQUIRE(s.rejectedEmptyZone == 1);
+        REQUIRE(s.rejectedBadDatetime == 1);
+        REQUIRE(s.rejectedHourRange == 1);
+#else
+        REQUIRE(s.bytesRead == 0);
+        REQUIRE(s.rowsSeen == 0);
+        REQUIRE(s.parseNs == 0);
+#endif
+    };
+    for (IngestMode mode : {IngestMode::Stream, IngestMode::Mapped, IngestMode::Parallel, IngestMode::Pipelined}) {
+        TripAnalyzer a;
+        a.setIngestMode(mode);
+        a.ingestFile(path);
+        check(a);
+    }
+    for (RowScanner scanner : {RowScanner::Scalar, RowScanner::AVX2}) {
+        TripAnalyzer a;
+        a.setRowScanner(scanner);
+        a.ingestBuffer(data);
+        check(a);
+    }
+    {
+        TripAnalyzer a;
+        a.beginConcurrent(4);
+        a.ingestBuffer(data);
+        a.endConcurrent();
+        check(a);
+    }
+
+    // Zones that show up a chunk at a time make the tables grow under the rows.
+    TripAnalyzer grown;
+    for (int i = 0; i < 5000; ++i)
+        grown.feed(tripRow(1, "Z" + std::to_string(i), 10));
+    grown.endStream();
+    const IngestStats& s = grown.ingestStats();
+#if TRIP_STATS
+    REQUIRE(s.rowsAccepted == 5000);
+    REQUIRE(s.rehashes >= 10);
+    REQUIRE(s.parseNs > 0);
+    REQUIRE(s.aggregateNs > 0);
+#else
+    REQUIRE(s.rehashes == 0);
+#endif
+    grown.resetIngestStats();
+    REQUIRE(grown.ingestStats().rowsSeen == 0);
+
+    std::remove(path.c_str());
+}